@@ -0,0 +1,547 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "btree.h"
+
+/*
+ * An ordered hash kept in a B+tree.
+ *
+ * Keys are sorted by memcmp() and then by length, which is the same
+ * order strcmp() gives for C strings, so EACH_HASH() walks the keys
+ * in sorted order and hash_last()/hash_prev() walk them backwards.
+ * hash_seek() positions at the first key >= a given key for range and
+ * prefix scans.
+ *
+ * The entries live in the leaves, which are linked for iteration.
+ * Interior nodes hold copies of the first key of each child after
+ * the first.  Each node also keeps the first 8 bytes of every key as
+ * a big-endian u64 so most compares in a search don't touch the keys
+ * themselves.
+ *
+ * Deletes just remove the entry from its leaf; nodes are never merged
+ * so a leaf can be left empty.  The space is reused by later inserts
+ * into the same range.
+ */
+
+#define	ORDER		32	/* max entries in a node */
+#define	MAXDEPTH	32
+
+typedef struct {
+	u32	klen;		/* key len */
+	u32	dlen;		/* data len */
+	char	key[0] __attribute__((aligned(8))); /* key and data here */
+} ent;
+
+typedef struct bnode bnode;
+struct bnode {
+	u16	n;		/* entries, or separators in an interior node */
+	u8	leaf;
+	bnode	*prev, *next;	/* leaves: neighbors in key order */
+	u64	pfx[ORDER+1];	/* PFX() of e[i] */
+	ent	*e[ORDER+1];	/* entries, or separator for child[i+1] */
+	bnode	*child[0];	/* interior nodes only, ORDER+2 of them */
+};
+
+#define	LEAFSIZE	sizeof(bnode)
+#define	NODESIZE	(sizeof(bnode) + (ORDER+2) * sizeof(bnode *))
+
+typedef struct {
+	hash	hdr;		/* std header for hash_* wrappers */
+	bnode	*root;
+	bnode	*head, *tail;	/* first and last leaf */
+	int	cnt;		/* number of items in hash */
+
+	/* for nextkey .. */
+	bnode	*curleaf;
+	int	curidx;
+} btree;
+
+/*
+ * Same as DOFF() in memhash.c
+ */
+private inline int
+DOFF(int klen, int dlen)
+{
+	int	mask;
+
+	if ((sizeof(void*) == 8) && (dlen >= 8)) {
+		mask = 8-1;
+	} else if (dlen >= 4) {
+		mask = 4-1;
+	} else if (dlen >= 2) {
+		mask = 2-1;
+	} else {
+		/* no alignment */
+		return (klen);
+	}
+	return ((klen + mask) & ~mask);
+}
+
+/* the first 8 bytes of a key as a big-endian number */
+private inline u64
+PFX(void *kptr, int klen)
+{
+	u64	x = 0;
+
+	memcpy(&x, kptr, min(klen, 8));
+	return (__builtin_bswap64(x));
+}
+
+private inline int
+keycmp(void *k1, int l1, void *k2, int l2)
+{
+	int	c;
+
+	if ((c = memcmp(k1, k2, min(l1, l2)))) return (c);
+	return (l1 - l2);
+}
+
+/* compare key to entry i in node */
+private inline int
+cmp(bnode *b, int i, u64 pfx, void *kptr, int klen)
+{
+	if (pfx != b->pfx[i]) return ((pfx < b->pfx[i]) ? -1 : 1);
+	return (keycmp(kptr, klen, b->e[i]->key, b->e[i]->klen));
+}
+
+/* first i where e[i] >= key */
+private inline int
+lowerbound(bnode *b, u64 pfx, void *kptr, int klen)
+{
+	int	lo = 0, hi = b->n, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cmp(b, mid, pfx, kptr, klen) > 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return (lo);
+}
+
+/* first i where e[i] > key, the child to follow in an interior node */
+private inline int
+upperbound(bnode *b, u64 pfx, void *kptr, int klen)
+{
+	int	lo = 0, hi = b->n, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cmp(b, mid, pfx, kptr, klen) >= 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return (lo);
+}
+
+private ent *
+newent(void *kptr, int klen, void *dptr, int dlen)
+{
+	ent	*e;
+	int	doff = DOFF(klen, dlen);
+
+	e = malloc(sizeof(ent) + doff + dlen);
+	e->klen = klen;
+	e->dlen = dlen;
+	memcpy(e->key, kptr, klen);
+	if (dptr) {
+		memcpy(e->key + doff, dptr, dlen);
+	} else {
+		memset(e->key + doff, 0, dlen);
+	}
+	return (e);
+}
+
+private inline void
+setptrs(btree *h, ent *e)
+{
+	h->hdr.kptr = e->key;
+	h->hdr.klen = e->klen;
+	h->hdr.vptr = e->key + DOFF(e->klen, e->dlen);
+	h->hdr.vlen = e->dlen;
+}
+
+private inline void
+clrptrs(btree *h)
+{
+	h->hdr.kptr = h->hdr.vptr = 0;
+	h->hdr.klen = h->hdr.vlen = 0;
+}
+
+/*
+ * Create a new hash structure.
+ */
+hash *
+btree_new(int flags, va_list ap)
+{
+	btree	*h;
+
+	h = new(btree);
+	h->root = calloc(1, LEAFSIZE);
+	h->root->leaf = 1;
+	h->head = h->tail = h->root;
+	return ((hash *)h);
+}
+
+private void
+freenode(bnode *b)
+{
+	int	i;
+
+	for (i = 0; i < b->n; i++) free(b->e[i]);
+	unless (b->leaf) {
+		for (i = 0; i <= b->n; i++) freenode(b->child[i]);
+	}
+	free(b);
+}
+
+int
+btree_free(hash *_h)
+{
+	btree	*h = (btree *)_h;
+
+	freenode(h->root);
+	return (0);
+}
+
+/*
+ * Find the leaf where key belongs and the index of the first entry
+ * >= key in that leaf.  The path down is saved in stk/idx if given.
+ */
+private bnode *
+findleaf(btree *h, void *kptr, int klen, int *ip,
+    bnode **stk, int *idx, int *depth)
+{
+	bnode	*b = h->root;
+	u64	pfx = PFX(kptr, klen);
+	int	i, d = 0;
+
+	while (!b->leaf) {
+		i = upperbound(b, pfx, kptr, klen);
+		if (stk) {
+			assert(d < MAXDEPTH);
+			stk[d] = b;
+			idx[d] = i;
+		}
+		d++;
+		b = b->child[i];
+	}
+	if (depth) *depth = d;
+	*ip = lowerbound(b, pfx, kptr, klen);
+	return (b);
+}
+
+void *
+btree_fetch(hash *_h, void *kptr, int klen)
+{
+	btree	*h = (btree *)_h;
+	bnode	*b;
+	int	i;
+
+	b = findleaf(h, kptr, klen, &i, 0, 0, 0);
+	if ((i < b->n) &&
+	    !keycmp(kptr, klen, b->e[i]->key, b->e[i]->klen)) {
+		setptrs(h, b->e[i]);
+		return (h->hdr.vptr);
+	}
+	clrptrs(h);
+	return (0);
+}
+
+/*
+ * Insert 'e' at i in b and split nodes on the way up as needed.
+ */
+private void
+addent(btree *h, bnode *b, int i, ent *e, bnode **stk, int *idx, int d)
+{
+	bnode	*r, *p;
+	ent	*sep;
+	int	j, m;
+
+	memmove(&b->e[i+1], &b->e[i], (b->n - i) * sizeof(ent *));
+	memmove(&b->pfx[i+1], &b->pfx[i], (b->n - i) * sizeof(u64));
+	b->e[i] = e;
+	b->pfx[i] = PFX(e->key, e->klen);
+	b->n++;
+	if (b->n <= ORDER) return;
+
+	/* split the leaf, the right half gets a copy of its first key */
+	m = b->n / 2;
+	r = calloc(1, LEAFSIZE);
+	r->leaf = 1;
+	r->n = b->n - m;
+	memcpy(r->e, &b->e[m], r->n * sizeof(ent *));
+	memcpy(r->pfx, &b->pfx[m], r->n * sizeof(u64));
+	b->n = m;
+	if ((r->next = b->next)) {
+		r->next->prev = r;
+	} else {
+		h->tail = r;
+	}
+	b->next = r;
+	r->prev = b;
+	sep = newent(r->e[0]->key, r->e[0]->klen, 0, 0);
+
+	/* push the separator up until a node has room */
+	while (1) {
+		if (d == 0) {
+			/* new root */
+			p = calloc(1, NODESIZE);
+			p->n = 1;
+			p->e[0] = sep;
+			p->pfx[0] = PFX(sep->key, sep->klen);
+			p->child[0] = b;
+			p->child[1] = r;
+			h->root = p;
+			return;
+		}
+		p = stk[--d];
+		i = idx[d];
+		memmove(&p->e[i+1], &p->e[i], (p->n - i) * sizeof(ent *));
+		memmove(&p->pfx[i+1], &p->pfx[i], (p->n - i) * sizeof(u64));
+		memmove(&p->child[i+2], &p->child[i+1],
+		    (p->n - i) * sizeof(bnode *));
+		p->e[i] = sep;
+		p->pfx[i] = PFX(sep->key, sep->klen);
+		p->child[i+1] = r;
+		p->n++;
+		if (p->n <= ORDER) return;
+
+		/* split interior node, the middle separator moves up */
+		m = p->n / 2;
+		sep = p->e[m];
+		b = p;
+		r = calloc(1, NODESIZE);
+		r->n = p->n - m - 1;
+		for (j = 0; j < r->n; j++) {
+			r->e[j] = p->e[m + 1 + j];
+			r->pfx[j] = p->pfx[m + 1 + j];
+		}
+		for (j = 0; j <= r->n; j++) r->child[j] = p->child[m + 1 + j];
+		p->n = m;
+	}
+}
+
+void *
+btree_insert(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	btree	*h = (btree *)_h;
+	bnode	*stk[MAXDEPTH];
+	int	idx[MAXDEPTH];
+	bnode	*b;
+	ent	*e;
+	int	i, d;
+
+	b = findleaf(h, kptr, klen, &i, stk, idx, &d);
+	if ((i < b->n) &&
+	    !keycmp(kptr, klen, b->e[i]->key, b->e[i]->klen)) {
+		/* found one */
+		setptrs(h, b->e[i]);
+		errno = EEXIST;
+		return (0);
+	}
+	e = newent(kptr, klen, dptr, dlen);
+	addent(h, b, i, e, stk, idx, d);
+	h->cnt++;
+	setptrs(h, e);
+	return (h->hdr.vptr);
+}
+
+void *
+btree_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	btree	*h = (btree *)_h;
+	bnode	*b;
+	ent	*e;
+	int	i;
+
+	if (btree_insert(_h, kptr, klen, dptr, dlen)) return (h->hdr.vptr);
+
+	/* existing node, overwrite */
+	b = findleaf(h, kptr, klen, &i, 0, 0, 0);
+	e = b->e[i];
+	if (e->dlen != dlen) {
+		free(e);
+		b->e[i] = e = newent(kptr, klen, dptr, dlen);
+	} else if (dptr) {
+		memcpy(e->key + DOFF(klen, dlen), dptr, dlen);
+	} else {
+		memset(e->key + DOFF(klen, dlen), 0, dlen);
+	}
+	setptrs(h, e);
+	return (h->hdr.vptr);
+}
+
+int
+btree_delete(hash *_h, void *kptr, int klen)
+{
+	btree	*h = (btree *)_h;
+	bnode	*b;
+	int	i;
+
+	b = findleaf(h, kptr, klen, &i, 0, 0, 0);
+	unless ((i < b->n) &&
+	    !keycmp(kptr, klen, b->e[i]->key, b->e[i]->klen)) {
+		errno = ENOENT;
+		return (-1);
+	}
+	free(b->e[i]);
+	b->n--;
+	memmove(&b->e[i], &b->e[i+1], (b->n - i) * sizeof(ent *));
+	memmove(&b->pfx[i], &b->pfx[i+1], (b->n - i) * sizeof(u64));
+	h->cnt--;
+	clrptrs(h);
+	return (0);
+}
+
+/*
+ * Set the cursor to entry i of leaf b, moving forward over empty
+ * leaves.
+ */
+private void *
+curfwd(btree *h, bnode *b, int i)
+{
+	while (b && (i >= b->n)) {
+		b = b->next;
+		i = 0;
+	}
+	h->curleaf = b;
+	h->curidx = i;
+	unless (b) {
+		clrptrs(h);
+		return (0);
+	}
+	setptrs(h, b->e[i]);
+	return (h->hdr.kptr);
+}
+
+/* same backwards */
+private void *
+curback(btree *h, bnode *b, int i)
+{
+	while (b && (i < 0)) {
+		if ((b = b->prev)) i = b->n - 1;
+	}
+	h->curleaf = b;
+	h->curidx = i;
+	unless (b) {
+		clrptrs(h);
+		return (0);
+	}
+	setptrs(h, b->e[i]);
+	return (h->hdr.kptr);
+}
+
+void *
+btree_first(hash *_h)
+{
+	btree	*h = (btree *)_h;
+
+	return (curfwd(h, h->head, 0));
+}
+
+void *
+btree_next(hash *_h)
+{
+	btree	*h = (btree *)_h;
+
+	unless (h->curleaf) return (0);
+	return (curfwd(h, h->curleaf, h->curidx + 1));
+}
+
+void *
+btree_last(hash *_h)
+{
+	btree	*h = (btree *)_h;
+
+	return (curback(h, h->tail, h->tail->n - 1));
+}
+
+void *
+btree_prev(hash *_h)
+{
+	btree	*h = (btree *)_h;
+
+	unless (h->curleaf) return (0);
+	return (curback(h, h->curleaf, h->curidx - 1));
+}
+
+/*
+ * Move the cursor to the first key >= (kptr, klen).
+ */
+void *
+btree_seek(hash *_h, void *kptr, int klen)
+{
+	btree	*h = (btree *)_h;
+	bnode	*b;
+	int	i;
+
+	b = findleaf(h, kptr, klen, &i, 0, 0, 0);
+	unless (curfwd(h, b, i)) return (0);
+	return (h->hdr.vptr);
+}
+
+int
+btree_count(hash *_h)
+{
+	btree	*h = (btree *)_h;
+
+	return (h->cnt);
+}
+
+/* add up the nodes under 'b' for btree_stats() */
+private void
+nodestats(bnode *b, hashstats *s)
+{
+	int	i;
+
+	for (i = 0; i < b->n; i++) {
+		s->bytes += sizeof(ent) +
+		    DOFF(b->e[i]->klen, b->e[i]->dlen) + b->e[i]->dlen;
+	}
+	if (b->leaf) {
+		s->slots += ORDER;
+		s->bytes += LEAFSIZE;
+		return;
+	}
+	s->bytes += NODESIZE;
+	for (i = 0; i <= b->n; i++) nodestats(b->child[i], s);
+}
+
+/*
+ * Here a probe is a node, and every search goes from the root to a
+ * leaf so they all take the depth of the tree.  The slots are the
+ * room in the leaves.
+ */
+int
+btree_stats(hash *_h, hashstats *s)
+{
+	btree	*h = (btree *)_h;
+	bnode	*b;
+	u32	depth = 1;
+
+	for (b = h->root; !b->leaf; b = b->child[0]) depth++;
+	s->maxprobe = depth;
+	s->meanprobe = depth;
+	s->bytes = sizeof(btree);
+	nodestats(h->root, s);
+	return (0);
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+hash	*btree_new(int flags, va_list ap);
+int	btree_free(hash *h);
+
+void	*btree_fetch(hash *h, void *kptr, int klen);
+void	*btree_insert(hash *h, void *kptr, int klen, void *val, int vlen);
+void	*btree_store(hash *h, void *kptr, int klen, void *val, int vlen);
+int	btree_delete(hash *h, void *kptr, int klen);
+
+void	*btree_first(hash *h);
+void	*btree_next(hash *h);
+void	*btree_last(hash *h);
+void	*btree_prev(hash *h);
+void	*btree_seek(hash *h, void *kptr, int klen);
+
+int	btree_count(hash *h);
+int	btree_stats(hash *h, hashstats *s);
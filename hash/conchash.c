@@ -0,0 +1,293 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "conchash.h"
+#include "utils/crc32c.h"
+
+#include <pthread.h>
+
+/*
+ * A hash that can be used from many threads at once.
+ *
+ * The keys are split across a power of 2 number of shards by the top
+ * bits of their hash, and each shard is a memhash protected by its
+ * own mutex.  Threads working on different shards never touch the
+ * same lock or cache lines.
+ *
+ * The usual hash_fetch() returns data through h->kptr/h->vptr which
+ * is shared by every thread, so threads must use hash_fetchCopy()
+ * instead.  hash_store(), hash_insert() and hash_delete() are safe to
+ * call from any thread and don't touch h->kptr/h->vptr, but the
+ * pointer returned by store and insert is only good until another
+ * thread deletes or grows that key.  Walking the hash with EACH_HASH()
+ * is only allowed when no other thread is using it.
+ */
+
+#define	HASH(buf, len) crc32c(0, buf, len)
+#define	DEFAULT_SHARDS	64
+
+typedef struct {
+	pthread_mutex_t	lock;
+	hash	*h;		/* a memhash */
+} __attribute__((aligned(64))) shard;	/* one cache line each */
+
+typedef struct {
+	hash	hdr;
+	shard	*shards;
+	u32	nshards;	/* power of 2 */
+	u32	shift;		/* hash >> shift picks the shard */
+	int	lastshard;	/* for nextkey */
+} conchash;
+
+/*
+ * usage: h = hash_new(HASH_CONCURRENT | HASH_SHARDS(nshards))
+ *
+ * nshards is rounded up to a power of 2, or left out for a default.
+ * Any other HASH_* options are passed to each shard.
+ */
+hash *
+conchash_new(int flags, va_list ap)
+{
+	conchash	*h;
+	u32	n;
+	int	i;
+
+	n = (flags & HASH_SHARDMASK) >> 16;
+	flags &= ~HASH_SHARDMASK;
+	unless (n) n = DEFAULT_SHARDS;
+	h = new(conchash);
+	h->nshards = 1;
+	h->shift = 32;
+	while (h->nshards < n) {
+		h->nshards <<= 1;
+		--h->shift;
+	}
+	if (posix_memalign((void **)&h->shards, sizeof(shard),
+	    h->nshards * sizeof(shard))) {
+		free(h);
+		return (0);
+	}
+	for (i = 0; i < h->nshards; i++) {
+		pthread_mutex_init(&h->shards[i].lock, 0);
+		h->shards[i].h = hash_new(HASH_MEMHASH | flags);
+	}
+	return ((hash *)h);
+}
+
+int
+conchash_free(hash *_h)
+{
+	conchash	*h = (conchash *)_h;
+	int	i;
+
+	for (i = 0; i < h->nshards; i++) {
+		hash_free(h->shards[i].h);
+		pthread_mutex_destroy(&h->shards[i].lock);
+	}
+	free(h->shards);
+	return (0);
+}
+
+private inline shard *
+getshard(conchash *h, void *kptr, int klen)
+{
+	/* shift by 32 is undefined, so 1 shard is special */
+	if (h->nshards == 1) return (h->shards);
+	return (&h->shards[HASH(kptr, klen) >> h->shift]);
+}
+
+/*
+ * Not thread safe, use hash_fetchCopy().
+ */
+void *
+conchash_fetch(hash *_h, void *kptr, int klen)
+{
+	conchash	*h = (conchash *)_h;
+	shard	*s = getshard(h, kptr, klen);
+	void	*ret;
+
+	pthread_mutex_lock(&s->lock);
+	ret = hash_fetch(s->h, kptr, klen);
+	h->hdr.kptr = s->h->kptr;
+	h->hdr.klen = s->h->klen;
+	h->hdr.vptr = s->h->vptr;
+	h->hdr.vlen = s->h->vlen;
+	pthread_mutex_unlock(&s->lock);
+	return (ret);
+}
+
+/*
+ * Copy the data for a key into vbuf while holding the shard lock.
+ */
+int
+conchash_fetchCopy(hash *_h, void *kptr, int klen, void *vbuf, int vsize)
+{
+	conchash	*h = (conchash *)_h;
+	shard	*s = getshard(h, kptr, klen);
+	int	ret;
+
+	pthread_mutex_lock(&s->lock);
+	if (hash_fetch(s->h, kptr, klen)) {
+		ret = s->h->vlen;
+		if (vbuf) memcpy(vbuf, s->h->vptr, min(ret, vsize));
+	} else {
+		ret = -1;
+	}
+	pthread_mutex_unlock(&s->lock);
+	unless (ret >= 0) errno = ENOENT;
+	return (ret);
+}
+
+void *
+conchash_insert(hash *_h, void *kptr, int klen, void *val, int vlen)
+{
+	conchash	*h = (conchash *)_h;
+	shard	*s = getshard(h, kptr, klen);
+	void	*ret;
+
+	pthread_mutex_lock(&s->lock);
+	ret = hash_insert(s->h, kptr, klen, val, vlen);
+	pthread_mutex_unlock(&s->lock);
+	return (ret);
+}
+
+void *
+conchash_store(hash *_h, void *kptr, int klen, void *val, int vlen)
+{
+	conchash	*h = (conchash *)_h;
+	shard	*s = getshard(h, kptr, klen);
+	void	*ret;
+
+	pthread_mutex_lock(&s->lock);
+	ret = hash_store(s->h, kptr, klen, val, vlen);
+	pthread_mutex_unlock(&s->lock);
+	return (ret);
+}
+
+int
+conchash_delete(hash *_h, void *kptr, int klen)
+{
+	conchash	*h = (conchash *)_h;
+	shard	*s = getshard(h, kptr, klen);
+	int	ret;
+
+	pthread_mutex_lock(&s->lock);
+	ret = hash_delete(s->h, kptr, klen);
+	pthread_mutex_unlock(&s->lock);
+	return (ret);
+}
+
+void *
+conchash_first(hash *_h)
+{
+	conchash	*h = (conchash *)_h;
+
+	h->lastshard = -1;
+	h->hdr.kptr = 0;
+	return (conchash_next(_h));
+}
+
+/*
+ * Walk each shard in turn.  Not thread safe.
+ */
+void *
+conchash_next(hash *_h)
+{
+	conchash	*h = (conchash *)_h;
+	hash	*sh;
+
+	if (h->lastshard >= 0) {
+		sh = h->shards[h->lastshard].h;
+		hash_next(sh);
+	} else {
+		sh = 0;
+	}
+	while (!sh || !sh->kptr) {
+		if (++h->lastshard >= h->nshards) {
+			h->hdr.kptr = h->hdr.vptr = 0;
+			h->hdr.klen = h->hdr.vlen = 0;
+			return (0);
+		}
+		sh = h->shards[h->lastshard].h;
+		hash_first(sh);
+	}
+	h->hdr.kptr = sh->kptr;
+	h->hdr.klen = sh->klen;
+	h->hdr.vptr = sh->vptr;
+	h->hdr.vlen = sh->vlen;
+	return (h->hdr.kptr);
+}
+
+/*
+ * Reserve room for an even share of 'n' keys in each shard, plus a
+ * little for the uneven split.
+ */
+int
+conchash_reserve(hash *_h, int n)
+{
+	conchash	*h = (conchash *)_h;
+	int	i, per = n / h->nshards;
+
+	per += per / 8;
+	for (i = 0; i < h->nshards; i++) {
+		pthread_mutex_lock(&h->shards[i].lock);
+		hash_reserve(h->shards[i].h, per);
+		pthread_mutex_unlock(&h->shards[i].lock);
+	}
+	return (0);
+}
+
+int
+conchash_count(hash *_h)
+{
+	conchash	*h = (conchash *)_h;
+	int	i, sum = 0;
+
+	for (i = 0; i < h->nshards; i++) {
+		pthread_mutex_lock(&h->shards[i].lock);
+		sum += hash_count(h->shards[i].h);
+		pthread_mutex_unlock(&h->shards[i].lock);
+	}
+	return (sum);
+}
+
+/*
+ * The shards added together.  maxprobe is the worst of any shard.
+ */
+int
+conchash_stats(hash *_h, hashstats *s)
+{
+	conchash	*h = (conchash *)_h;
+	hashstats	ss;
+	double	sum = 0;
+	int	i;
+
+	s->bytes = sizeof(conchash) + h->nshards * sizeof(shard);
+	for (i = 0; i < h->nshards; i++) {
+		pthread_mutex_lock(&h->shards[i].lock);
+		hash_stats(h->shards[i].h, &ss);
+		pthread_mutex_unlock(&h->shards[i].lock);
+		s->slots += ss.slots;
+		s->bytes += ss.bytes;
+		s->resizes += ss.resizes;
+		s->resize_ns += ss.resize_ns;
+		s->maxprobe = max(s->maxprobe, ss.maxprobe);
+		sum += ss.meanprobe * ss.count;
+	}
+	if (s->count) s->meanprobe = sum / s->count;
+	return (0);
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+hash	*conchash_new(int flags, va_list ap);
+int	conchash_free(hash *h);
+
+void	*conchash_fetch(hash *h, void *kptr, int klen);
+int	conchash_fetchCopy(hash *h, void *kptr, int klen, void *vbuf, int vsize);
+void	*conchash_insert(hash *h, void *kptr, int klen, void *val, int vlen);
+void	*conchash_store(hash *h, void *kptr, int klen, void *val, int vlen);
+int	conchash_delete(hash *h, void *kptr, int klen);
+
+void	*conchash_first(hash *h);
+void	*conchash_next(hash *h);
+
+int	conchash_count(hash *h);
+int	conchash_reserve(hash *h, int n);
+int	conchash_stats(hash *h, hashstats *s);
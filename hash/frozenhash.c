@@ -0,0 +1,335 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "frozenhash.h"
+#include "utils/crc32c.h"
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * A read-only hash served directly out of a mmap'ed file.
+ *
+ * hash_toFrozen() writes any hash to a file and
+ * hash_open(HASH_MMAP, file, O_RDONLY, 0) maps it back in.  Nothing
+ * is parsed or copied at open time; a fetch hashes the key, probes
+ * the slot table in the file and returns a pointer into the mapping.
+ * Since the mapping is shared, every process reading the same file
+ * shares the same pages.
+ *
+ * File layout, in native byte order:
+ *
+ *   header	magic, version and sizes (struct fhdr)
+ *   slots	nslots slots (power of 2), linear probing, < 50% full
+ *   heap	one record per key: value, key, padded to 8 bytes
+ *
+ * A slot with off == 0 is empty since no record can start inside
+ * the header.  Values are 8-byte aligned in the file so they can be
+ * read in place as u32/u64/pointers-sized data.
+ *
+ * Only the header is checked at open time, so a slot is checked
+ * against the size of the file before its record is used and one
+ * whose record isn't inside the heap is ignored.
+ */
+
+#define	HASH(buf, len)	crc32c(0, buf, len)
+#define	MAGIC		"BKFROZEN"
+#define	VERSION		1
+#define	ALIGN8(x)	(((x) + 7) & ~(u64)7)
+
+typedef struct {
+	char	magic[8];
+	u32	version;
+	u32	nslots;		/* power of 2 */
+	u32	cnt;		/* number of keys */
+	u32	pad;
+	u64	size;		/* total file size */
+} fhdr;
+
+typedef struct {
+	u32	hash;
+	u32	klen;
+	u32	vlen;
+	u32	pad;
+	u64	off;		/* file offset of value, 0 == empty */
+} fslot;
+
+typedef struct {
+	hash	hdr;
+	u8	*map;
+	u64	size;
+	u64	heap;		/* file offset of first record */
+	fslot	*slots;
+	u32	nslots;
+	u32	cnt;
+	int	lastidx;	/* for nextkey */
+} frozenhash;
+
+/*
+ * usage: h = hash_open(HASH_MMAP, file, O_RDONLY, 0)
+ *
+ * Returns 0 with errno set if the file can't be mapped or isn't a
+ * frozen hash.  Use hash_close() when done.
+ */
+hash *
+frozenhash_open(char *file, int flags, mode_t mode, va_list ap)
+{
+	frozenhash	*h;
+	fhdr	*fh;
+	struct	stat st;
+	void	*map;
+	int	fd;
+
+	if ((flags & O_ACCMODE) != O_RDONLY) {
+		errno = EROFS;
+		return (0);
+	}
+	if ((fd = open(file, O_RDONLY, 0)) < 0) return (0);
+	if (fstat(fd, &st)) {
+		close(fd);
+		return (0);
+	}
+	if (st.st_size < sizeof(fhdr)) {
+		close(fd);
+		errno = EINVAL;
+		return (0);
+	}
+	map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return (0);
+
+	fh = map;
+	if (memcmp(fh->magic, MAGIC, sizeof(fh->magic)) ||
+	    (fh->version != VERSION) ||
+	    (fh->size != st.st_size) ||
+	    !fh->nslots || (fh->nslots & (fh->nslots - 1)) ||
+	    (sizeof(fhdr) + (u64)fh->nslots * sizeof(fslot) > fh->size)) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return (0);
+	}
+	h = new(frozenhash);
+	h->map = map;
+	h->size = st.st_size;
+	h->slots = (fslot *)(h->map + sizeof(fhdr));
+	h->nslots = fh->nslots;
+	h->heap = sizeof(fhdr) + (u64)h->nslots * sizeof(fslot);
+	h->cnt = fh->cnt;
+	return ((hash *)h);
+}
+
+int
+frozenhash_close(hash *_h)
+{
+	frozenhash	*h = (frozenhash *)_h;
+
+	munmap(h->map, h->size);
+	return (0);
+}
+
+/* is the record for a full slot outside the heap? */
+private inline int
+badslot(frozenhash *h, fslot *s)
+{
+	return ((s->off < h->heap) || (s->off > h->size) ||
+	    ((u64)s->vlen + s->klen > h->size - s->off));
+}
+
+private inline void
+setptrs(frozenhash *h, fslot *s)
+{
+	h->hdr.vptr = h->map + s->off;
+	h->hdr.vlen = s->vlen;
+	h->hdr.kptr = h->map + s->off + s->vlen;
+	h->hdr.klen = s->klen;
+}
+
+/*
+ * The pointer returned points into a read-only mapping.
+ */
+void *
+frozenhash_fetch(hash *_h, void *kptr, int klen)
+{
+	frozenhash	*h = (frozenhash *)_h;
+	u32	hash = HASH(kptr, klen);
+	u32	i, n;
+	fslot	*s;
+
+	n = hash & (h->nslots - 1);
+	/* a bad file might not have an empty slot */
+	for (i = 0; i < h->nslots; i++) {
+		unless ((s = &h->slots[n])->off) break;
+		if ((s->hash == hash) && (s->klen == klen) &&
+		    !badslot(h, s) &&
+		    !memcmp(h->map + s->off + s->vlen, kptr, klen)) {
+			setptrs(h, s);
+			return (h->hdr.vptr);
+		}
+		n = (n + 1) & (h->nslots - 1);
+	}
+	h->hdr.kptr = h->hdr.vptr = 0;
+	h->hdr.klen = h->hdr.vlen = 0;
+	errno = EINVAL;
+	return (0);
+}
+
+void *
+frozenhash_store(hash *h, void *kptr, int klen, void *val, int vlen)
+{
+	errno = EROFS;
+	return (0);
+}
+
+int
+frozenhash_delete(hash *h, void *kptr, int klen)
+{
+	errno = EROFS;
+	return (-1);
+}
+
+void *
+frozenhash_first(hash *_h)
+{
+	frozenhash	*h = (frozenhash *)_h;
+
+	h->lastidx = -1;
+	return (frozenhash_next(_h));
+}
+
+void *
+frozenhash_next(hash *_h)
+{
+	frozenhash	*h = (frozenhash *)_h;
+	int	n;
+
+	n = h->lastidx + 1;
+	while ((n < h->nslots) &&
+	    (!h->slots[n].off || badslot(h, &h->slots[n]))) {
+		++n;
+	}
+	h->lastidx = n;
+	if (n < h->nslots) {
+		setptrs(h, &h->slots[n]);
+	} else {
+		h->hdr.kptr = h->hdr.vptr = 0;
+	}
+	return (h->hdr.kptr);
+}
+
+int
+frozenhash_count(hash *_h)
+{
+	frozenhash	*h = (frozenhash *)_h;
+
+	return (h->cnt);
+}
+
+/*
+ * A key d slots past its home slot takes d+1 probes.  The bytes are
+ * the size of the mapping, which is shared with other processes.
+ */
+int
+frozenhash_stats(hash *_h, hashstats *s)
+{
+	frozenhash	*h = (frozenhash *)_h;
+	fslot	*sl;
+	u64	sum = 0;
+	u32	i, d;
+
+	s->slots = h->nslots;
+	s->bytes = sizeof(frozenhash) + h->size;
+	for (i = 0; i < h->nslots; i++) {
+		sl = &h->slots[i];
+		unless (sl->off) continue;
+		d = ((i - sl->hash) & (h->nslots - 1)) + 1;
+		sum += d;
+		if (d > s->maxprobe) s->maxprobe = d;
+	}
+	if (h->cnt) s->meanprobe = (double)sum / h->cnt;
+	return (0);
+}
+
+/*
+ * Write 'h' to 'path' in the format read by hash_open(HASH_MMAP).
+ *
+ * The file is written next to 'path' and renamed into place so
+ * processes that have the old file mapped are not disturbed.
+ * Returns -1 on error, or 0
+ */
+int
+hash_toFrozen(hash *h, char *path)
+{
+	fhdr	fh = {{0}};
+	fslot	*slots, *s;
+	FILE	*f;
+	char	*tmp;
+	u64	off, pad, zero = 0;
+	u32	n, cnt;
+	int	rc = -1;
+
+	assert(h && path);
+	cnt = hash_count(h);
+	n = 16;
+	while (n < 2 * cnt) n <<= 1;
+
+	/* place every key in the table and assign its record */
+	slots = calloc(n, sizeof(fslot));
+	off = sizeof(fhdr) + (u64)n * sizeof(fslot);
+	EACH_HASH(h) {
+		u32	hash = HASH(h->kptr, h->klen);
+		u32	i = hash & (n - 1);
+
+		while (slots[i].off) i = (i + 1) & (n - 1);
+		s = &slots[i];
+		s->hash = hash;
+		s->klen = h->klen;
+		s->vlen = h->vlen;
+		s->off = off;
+		off = ALIGN8(off + h->vlen + h->klen);
+	}
+	memcpy(fh.magic, MAGIC, sizeof(fh.magic));
+	fh.version = VERSION;
+	fh.nslots = n;
+	fh.cnt = cnt;
+	fh.size = off;
+
+	tmp = malloc(strlen(path) + 32);
+	sprintf(tmp, "%s.tmp%u", path, (u32)getpid());
+	unless (f = fopen(tmp, "w")) goto out;
+	fwrite(&fh, sizeof(fh), 1, f);
+	fwrite(slots, sizeof(fslot), n, f);
+
+	/* the records, in the same order as above */
+	EACH_HASH(h) {
+		fwrite(h->vptr, 1, h->vlen, f);
+		fwrite(h->kptr, 1, h->klen, f);
+		pad = ALIGN8(h->vlen + h->klen) - (h->vlen + h->klen);
+		if (pad) fwrite(&zero, 1, pad, f);
+	}
+	if (ferror(f) | fclose(f)) {
+		unlink(tmp);
+		goto out;
+	}
+	if (rename(tmp, path)) {
+		unlink(tmp);
+		goto out;
+	}
+	rc = 0;
+out:	free(tmp);
+	free(slots);
+	return (rc);
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+hash	*frozenhash_open(char *file, int flags, mode_t mode, va_list ap);
+int	frozenhash_close(hash *h);
+
+void	*frozenhash_fetch(hash *h, void *kptr, int klen);
+void	*frozenhash_store(hash *h, void *kptr, int klen, void *val, int vlen);
+int	frozenhash_delete(hash *h, void *kptr, int klen);
+
+void	*frozenhash_first(hash *h);
+void	*frozenhash_next(hash *h);
+
+int	frozenhash_count(hash *h);
+int	frozenhash_stats(hash *h, hashstats *s);
@@ -0,0 +1,682 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "hamt.h"
+#include "hashfn.h"
+
+#include <stdint.h>
+
+/*
+ * A hash array mapped trie with copy-on-write snapshots.
+ *
+ * Each node uses 5 bits of the key's hash to pick one of 32 children
+ * and only allocates the children that exist, found with a bitmap
+ * and popcount.  A child is another node or a leaf holding one key
+ * and its data.  Keys whose whole 32-bit hash is the same end up in a
+ * collision node that is searched linearly.
+ *
+ * Nodes and leaves are reference counted.  hash_snapshot() returns a
+ * new read-only hash that shares the root, which costs one atomic
+ * increment.  After that the writer copies each node on the path to a
+ * change before modifying it (path copying), so a snapshot never sees
+ * a node change and memory only grows with the part of the trie that
+ * was modified.  Nodes only the writer can see are changed in place.
+ *
+ * A snapshot can be handed to another thread and read there while the
+ * writer carries on.  Each thread should use its own snapshot (take a
+ * snapshot of the snapshot) or use hash_fetchCopy(), since hash_fetch()
+ * returns its results in the shared h->kptr/h->vptr.  Freeing a
+ * snapshot from any thread is safe.
+ */
+
+#define	BITS		5
+#define	MAXDEPTH	8	/* 7 levels of 5 bits, then collisions */
+
+#define	HASH(h, buf, len) hashfn((h)->fn, buf, len)
+
+/* children are nodes or leaves, leaves are tagged in the low bit */
+#define	ISLEAF(k)	((uintptr_t)(k) & 1)
+#define	LEAF(k)		((leaf *)((uintptr_t)(k) & ~(uintptr_t)1))
+#define	TAG(l)		((void *)((uintptr_t)(l) | 1))
+
+typedef struct {
+	u32	refs;		/* nodes pointing here */
+	u32	hash;
+	u32	klen;		/* key len */
+	u32	dlen;		/* data len */
+	char	key[0] __attribute__((aligned(8))); /* key and data here */
+} leaf;
+
+typedef struct {
+	u32	refs;		/* parents and hashes pointing here */
+	u32	map;		/* children present, or count if collision */
+	u8	collision;	/* all children are leaves with one hash */
+	void	*kid[0];
+} hnode;
+
+typedef struct {
+	hash	hdr;		/* std header for hash_* wrappers */
+	void	*root;		/* node or tagged leaf, 0 if empty */
+	int	cnt;		/* number of items in hash */
+	int	fn;		/* HASH_FN_* for keys */
+	u8	readonly;	/* a snapshot */
+
+	/* for nextkey .. */
+	int	depth;
+	hnode	*stk[MAXDEPTH];
+	int	idx[MAXDEPTH];
+} hamt;
+
+/*
+ * Same as DOFF() in memhash.c
+ */
+private inline int
+DOFF(int klen, int dlen)
+{
+	int	mask;
+
+	if ((sizeof(void*) == 8) && (dlen >= 8)) {
+		mask = 8-1;
+	} else if (dlen >= 4) {
+		mask = 4-1;
+	} else if (dlen >= 2) {
+		mask = 2-1;
+	} else {
+		/* no alignment */
+		return (klen);
+	}
+	return ((klen + mask) & ~mask);
+}
+
+private inline u32
+refs(u32 *r)
+{
+	return (__atomic_load_n(r, __ATOMIC_ACQUIRE));
+}
+
+private inline void
+ref(void *k)
+{
+	u32	*r = ISLEAF(k) ? &LEAF(k)->refs : &((hnode *)k)->refs;
+
+	__atomic_add_fetch(r, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Drop a reference to a child and free it when it was the last.
+ */
+private void
+unref(void *k)
+{
+	hnode	*n;
+	int	i, cnt;
+
+	unless (k) return;
+	if (ISLEAF(k)) {
+		if (__atomic_sub_fetch(&LEAF(k)->refs, 1, __ATOMIC_ACQ_REL)) {
+			return;
+		}
+		free(LEAF(k));
+		return;
+	}
+	n = k;
+	if (__atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL)) return;
+	cnt = n->collision ? n->map : __builtin_popcount(n->map);
+	for (i = 0; i < cnt; i++) unref(n->kid[i]);
+	free(n);
+}
+
+private inline int
+nkids(hnode *n)
+{
+	return (n->collision ? n->map : __builtin_popcount(n->map));
+}
+
+private inline int
+keyeq(leaf *l, u32 hash, void *kptr, int klen)
+{
+	return ((l->hash == hash) && (l->klen == klen) &&
+	    !memcmp(l->key, kptr, klen));
+}
+
+/*
+ * usage: h = hash_new(HASH_HAMT)
+ */
+hash *
+hamt_new(int flags, va_list ap)
+{
+	hamt	*h;
+
+	h = new(hamt);
+	h->fn = flags & HASH_FNMASK;
+	return ((hash *)h);
+}
+
+int
+hamt_free(hash *_h)
+{
+	hamt	*h = (hamt *)_h;
+
+	unref(h->root);
+	return (0);
+}
+
+/*
+ * Return a read-only copy of 'h' that shares all of its nodes.
+ */
+hash *
+hamt_snapshot(hash *_h)
+{
+	hamt	*h = (hamt *)_h;
+	hamt	*s;
+
+	s = new(hamt);
+	s->hdr.ops = h->hdr.ops;
+	s->fn = h->fn;
+	s->cnt = h->cnt;
+	s->readonly = 1;
+	if ((s->root = h->root)) ref(s->root);
+	return ((hash *)s);
+}
+
+/*
+ * Return the leaf for a key or 0.  Doesn't touch h.
+ */
+private leaf *
+find(hamt *h, u32 hash, void *kptr, int klen)
+{
+	void	*k = h->root;
+	hnode	*n;
+	u32	bit;
+	int	i, shift = 0;
+
+	while (k) {
+		if (ISLEAF(k)) {
+			return (keyeq(LEAF(k), hash, kptr, klen) ? LEAF(k) : 0);
+		}
+		n = k;
+		if (n->collision) {
+			for (i = 0; i < n->map; i++) {
+				if (keyeq(LEAF(n->kid[i]), hash, kptr, klen)) {
+					return (LEAF(n->kid[i]));
+				}
+			}
+			return (0);
+		}
+		bit = 1u << ((hash >> shift) & 31);
+		unless (n->map & bit) return (0);
+		k = n->kid[__builtin_popcount(n->map & (bit - 1))];
+		shift += BITS;
+	}
+	return (0);
+}
+
+private inline void
+setkv(hamt *h, leaf *l)
+{
+	h->hdr.kptr = l->key;
+	h->hdr.klen = l->klen;
+	h->hdr.vptr = l->key + DOFF(l->klen, l->dlen);
+	h->hdr.vlen = l->dlen;
+}
+
+private inline void
+clearkv(hamt *h)
+{
+	h->hdr.kptr = h->hdr.vptr = 0;
+	h->hdr.klen = h->hdr.vlen = 0;
+}
+
+void *
+hamt_fetch(hash *_h, void *kptr, int klen)
+{
+	hamt	*h = (hamt *)_h;
+	leaf	*l;
+
+	if ((l = find(h, HASH(h, kptr, klen), kptr, klen))) {
+		setkv(h, l);
+	} else {
+		clearkv(h);
+		errno = EINVAL;
+	}
+	return (h->hdr.vptr);
+}
+
+/*
+ * Copy the data for a key into vbuf without touching h->kptr/h->vptr
+ * so one snapshot can be read by several threads.
+ */
+int
+hamt_fetchCopy(hash *_h, void *kptr, int klen, void *vbuf, int vsize)
+{
+	hamt	*h = (hamt *)_h;
+	leaf	*l;
+
+	unless (l = find(h, HASH(h, kptr, klen), kptr, klen)) {
+		errno = ENOENT;
+		return (-1);
+	}
+	if (vbuf) {
+		memcpy(vbuf, l->key + DOFF(l->klen, l->dlen), min(l->dlen, vsize));
+	}
+	return (l->dlen);
+}
+
+private leaf *
+newleaf(u32 hash, void *kptr, int klen, void *dptr, int dlen)
+{
+	int	doff = DOFF(klen, dlen);
+	leaf	*l = malloc(sizeof(leaf) + doff + dlen);
+
+	l->refs = 1;
+	l->hash = hash;
+	l->klen = klen;
+	l->dlen = dlen;
+	memcpy(l->key, kptr, klen);
+	if (dlen) {
+		if (dptr) {
+			memcpy(l->key + doff, dptr, dlen);
+		} else {
+			memset(l->key + doff, 0, dlen);
+		}
+	}
+	return (l);
+}
+
+private hnode *
+newnode(int cnt)
+{
+	hnode	*n = malloc(sizeof(hnode) + cnt * sizeof(void *));
+
+	n->refs = 1;
+	n->map = 0;
+	n->collision = 0;
+	return (n);
+}
+
+/*
+ * Return 'n' if nobody else can see it, or else a copy that the
+ * caller owns.  The copy shares the children and the caller's
+ * reference to 'n' moves to the copy.  'extra' kid slots are added
+ * at the end for the caller to use.
+ */
+private hnode *
+own(hnode *n, int extra)
+{
+	hnode	*c;
+	int	i, cnt = nkids(n);
+
+	if (refs(&n->refs) == 1) {
+		if (extra) {
+			n = realloc(n, sizeof(hnode) + (cnt+extra) * sizeof(void *));
+		}
+		return (n);
+	}
+	c = newnode(cnt + extra);
+	c->map = n->map;
+	c->collision = n->collision;
+	for (i = 0; i < cnt; i++) {
+		c->kid[i] = n->kid[i];
+		ref(c->kid[i]);
+	}
+	unref(n);
+	return (c);
+}
+
+/*
+ * Make the smallest subtree at 'shift' that holds the leaves a and b,
+ * which have different keys.
+ */
+private void *
+pair(leaf *a, leaf *b, int shift)
+{
+	hnode	*n;
+	u32	ba, bb;
+
+	if (shift >= 32) {
+		n = newnode(2);
+		n->collision = 1;
+		n->map = 2;
+		n->kid[0] = TAG(a);
+		n->kid[1] = TAG(b);
+		return (n);
+	}
+	ba = 1u << ((a->hash >> shift) & 31);
+	bb = 1u << ((b->hash >> shift) & 31);
+	if (ba == bb) {
+		n = newnode(1);
+		n->map = ba;
+		n->kid[0] = pair(a, b, shift + BITS);
+		return (n);
+	}
+	n = newnode(2);
+	n->map = ba | bb;
+	n->kid[ba < bb ? 0 : 1] = TAG(a);
+	n->kid[ba < bb ? 1 : 0] = TAG(b);
+	return (n);
+}
+
+/* what put() should do if the key exists */
+#define	PUT_STORE	1
+#define	PUT_INSERT	2
+
+/*
+ * Add or replace a key in the subtree 'k' at 'shift' and return the
+ * new subtree, which replaces 'k' in its parent.  The leaf for the
+ * key is returned in *lp.  If the key exists and 'mode' is
+ * PUT_INSERT then nothing changes and *lp is the existing leaf.
+ */
+private void *
+put(hamt *h, void *k, int shift, u32 hash, void *kptr, int klen,
+    void *dptr, int dlen, int mode, leaf **lp)
+{
+	hnode	*n;
+	leaf	*l, *old;
+	u32	bit;
+	int	i, cnt;
+
+	unless (k) {
+		*lp = newleaf(hash, kptr, klen, dptr, dlen);
+		h->cnt++;
+		return (TAG(*lp));
+	}
+	if (ISLEAF(k)) {
+		old = LEAF(k);
+		unless (keyeq(old, hash, kptr, klen)) {
+			*lp = newleaf(hash, kptr, klen, dptr, dlen);
+			h->cnt++;
+			return (pair(old, *lp, shift));
+		}
+		if (mode == PUT_INSERT) {
+			*lp = old;
+			return (k);
+		}
+		if ((refs(&old->refs) == 1) && (dlen <= old->dlen) &&
+		    (DOFF(klen, dlen) == DOFF(klen, old->dlen))) {
+			/* nobody else sees it, update in place */
+			old->dlen = dlen;
+			l = old;
+			if (dlen) {
+				if (dptr) {
+					memmove(l->key + DOFF(klen, dlen), dptr, dlen);
+				} else {
+					memset(l->key + DOFF(klen, dlen), 0, dlen);
+				}
+			}
+			*lp = l;
+			return (k);
+		}
+		*lp = newleaf(hash, kptr, klen, dptr, dlen);
+		unref(k);
+		return (TAG(*lp));
+	}
+	n = k;
+	if (n->collision) {
+		for (i = 0; i < n->map; i++) {
+			if (keyeq(LEAF(n->kid[i]), hash, kptr, klen)) break;
+		}
+		if (i < n->map) {
+			if (mode == PUT_INSERT) {
+				*lp = LEAF(n->kid[i]);
+				return (n);
+			}
+			n = own(n, 0);
+			n->kid[i] = put(h, n->kid[i], shift,
+			    hash, kptr, klen, dptr, dlen, mode, lp);
+			return (n);
+		}
+		n = own(n, 1);
+		*lp = newleaf(hash, kptr, klen, dptr, dlen);
+		h->cnt++;
+		n->kid[n->map++] = TAG(*lp);
+		return (n);
+	}
+	bit = 1u << ((hash >> shift) & 31);
+	i = __builtin_popcount(n->map & (bit - 1));
+	if (n->map & bit) {
+		if ((mode == PUT_INSERT) && ISLEAF(n->kid[i]) &&
+		    keyeq(LEAF(n->kid[i]), hash, kptr, klen)) {
+			/* don't copy the path for a failed insert */
+			*lp = LEAF(n->kid[i]);
+			return (n);
+		}
+		n = own(n, 0);
+		n->kid[i] = put(h, n->kid[i], shift + BITS,
+		    hash, kptr, klen, dptr, dlen, mode, lp);
+		return (n);
+	}
+	cnt = nkids(n);
+	n = own(n, 1);
+	memmove(&n->kid[i+1], &n->kid[i], (cnt - i) * sizeof(void *));
+	n->map |= bit;
+	*lp = newleaf(hash, kptr, klen, dptr, dlen);
+	h->cnt++;
+	n->kid[i] = TAG(*lp);
+	return (n);
+}
+
+void *
+hamt_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	hamt	*h = (hamt *)_h;
+	leaf	*l;
+
+	if (h->readonly) {
+		errno = EROFS;
+		return (0);
+	}
+	h->root = put(h, h->root, 0, HASH(h, kptr, klen),
+	    kptr, klen, dptr, dlen, PUT_STORE, &l);
+	setkv(h, l);
+	return (h->hdr.vptr);
+}
+
+void *
+hamt_insert(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	hamt	*h = (hamt *)_h;
+	leaf	*l;
+	int	cnt = h->cnt;
+
+	if (h->readonly) {
+		errno = EROFS;
+		return (0);
+	}
+	h->root = put(h, h->root, 0, HASH(h, kptr, klen),
+	    kptr, klen, dptr, dlen, PUT_INSERT, &l);
+	setkv(h, l);
+	if (h->cnt == cnt) {
+		/* ret 0, but h->kptr points at existing data */
+		errno = EEXIST;
+		return (0);
+	}
+	return (h->hdr.vptr);
+}
+
+/*
+ * Remove a key that is in the subtree 'k' at 'shift' and return the
+ * new subtree.  A node left with just one leaf is replaced by the leaf
+ * so the trie is the same shape it would be without the key.
+ */
+private void *
+del(hamt *h, void *k, int shift, u32 hash, void *kptr, int klen)
+{
+	hnode	*n;
+	void	*kid;
+	u32	bit;
+	int	i, cnt;
+
+	if (ISLEAF(k)) {
+		h->cnt--;
+		unref(k);
+		return (0);
+	}
+	n = k;
+	cnt = nkids(n);
+	if (n->collision) {
+		for (i = 0; i < cnt; i++) {
+			if (keyeq(LEAF(n->kid[i]), hash, kptr, klen)) break;
+		}
+		assert(i < cnt);
+		h->cnt--;
+		if (cnt == 2) {
+			kid = n->kid[!i];
+			ref(kid);
+			unref(n);
+			return (kid);
+		}
+		n = own(n, 0);
+		unref(n->kid[i]);
+		memmove(&n->kid[i], &n->kid[i+1], (cnt-i-1) * sizeof(void *));
+		n->map--;
+		return (n);
+	}
+	bit = 1u << ((hash >> shift) & 31);
+	i = __builtin_popcount(n->map & (bit - 1));
+	n = own(n, 0);
+	kid = del(h, n->kid[i], shift + BITS, hash, kptr, klen);
+	if (kid) {
+		n->kid[i] = kid;
+		unless ((cnt == 1) && ISLEAF(kid)) return (n);
+	} else {
+		memmove(&n->kid[i], &n->kid[i+1], (cnt-i-1) * sizeof(void *));
+		n->map &= ~bit;
+		if (cnt == 1) {
+			unref(n);
+			return (0);
+		}
+		unless ((cnt == 2) && ISLEAF(n->kid[0])) return (n);
+		kid = n->kid[0];
+	}
+	/* just one leaf left, it replaces this node */
+	ref(kid);
+	unref(n);
+	return (kid);
+}
+
+int
+hamt_delete(hash *_h, void *kptr, int klen)
+{
+	hamt	*h = (hamt *)_h;
+	u32	hash = HASH(h, kptr, klen);
+
+	if (h->readonly) {
+		errno = EROFS;
+		return (-1);
+	}
+	/* look first so a miss doesn't copy the path */
+	unless (find(h, hash, kptr, klen)) {
+		errno = ENOENT;
+		return (-1);
+	}
+	h->root = del(h, h->root, 0, hash, kptr, klen);
+	return (0);
+}
+
+/*
+ * Go down from 'k' to its first leaf, pushing the nodes on the way.
+ */
+private leaf *
+descend(hamt *h, void *k)
+{
+	while (!ISLEAF(k)) {
+		assert(h->depth < MAXDEPTH);
+		h->stk[h->depth] = k;
+		h->idx[h->depth] = 0;
+		h->depth++;
+		k = ((hnode *)k)->kid[0];
+	}
+	return (LEAF(k));
+}
+
+void *
+hamt_first(hash *_h)
+{
+	hamt	*h = (hamt *)_h;
+
+	h->depth = 0;
+	if (h->root) {
+		setkv(h, descend(h, h->root));
+	} else {
+		clearkv(h);
+	}
+	return (h->hdr.kptr);
+}
+
+void *
+hamt_next(hash *_h)
+{
+	hamt	*h = (hamt *)_h;
+	hnode	*n;
+	int	d;
+
+	while ((d = h->depth - 1) >= 0) {
+		n = h->stk[d];
+		if (++h->idx[d] < nkids(n)) {
+			setkv(h, descend(h, n->kid[h->idx[d]]));
+			return (h->hdr.kptr);
+		}
+		h->depth--;
+	}
+	clearkv(h);
+	return (0);
+}
+
+int
+hamt_count(hash *_h)
+{
+	hamt	*h = (hamt *)_h;
+
+	return (h->cnt);
+}
+
+/* add up the subtree 'k' at 'depth' for hamt_stats() */
+private void
+treestats(void *k, int depth, hashstats *s, u64 *sum)
+{
+	hnode	*n;
+	leaf	*l;
+	int	i;
+
+	if (ISLEAF(k)) {
+		l = LEAF(k);
+		s->bytes += sizeof(leaf) + DOFF(l->klen, l->dlen) + l->dlen;
+		*sum += depth;
+		if (depth > s->maxprobe) s->maxprobe = depth;
+		return;
+	}
+	n = k;
+	s->bytes += sizeof(hnode) + nkids(n) * sizeof(void *);
+	for (i = 0; i < nkids(n); i++) treestats(n->kid[i], depth + 1, s, sum);
+}
+
+/*
+ * Here a probe is a node or leaf on the way down.  There are no
+ * fixed slots so the load isn't reported.  Nodes shared with
+ * snapshots are counted in each of them.
+ */
+int
+hamt_stats(hash *_h, hashstats *s)
+{
+	hamt	*h = (hamt *)_h;
+	u64	sum = 0;
+
+	s->bytes = sizeof(hamt);
+	if (h->root) treestats(h->root, 1, s, &sum);
+	if (h->cnt) s->meanprobe = (double)sum / h->cnt;
+	return (0);
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+hash	*hamt_new(int flags, va_list ap);
+int	hamt_free(hash *h);
+
+void	*hamt_fetch(hash *h, void *kptr, int klen);
+int	hamt_fetchCopy(hash *h, void *kptr, int klen, void *vbuf, int vsize);
+void	*hamt_insert(hash *h, void *kptr, int klen, void *val, int vlen);
+void	*hamt_store(hash *h, void *kptr, int klen, void *val, int vlen);
+int	hamt_delete(hash *h, void *kptr, int klen);
+
+void	*hamt_first(hash *h);
+void	*hamt_next(hash *h);
+
+int	hamt_count(hash *h);
+int	hamt_stats(hash *h, hashstats *s);
+hash	*hamt_snapshot(hash *h);
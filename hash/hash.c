@@ -17,9 +17,18 @@
 #include "hash.h"
 #include "memhash.h"
 #include "u32hash.h"
+#include "simdhash.h"
+#include "u64hash.h"
+#include "conchash.h"
+#include "frozenhash.h"
+#include "perfhash.h"
+#include "btree.h"
+#include "strhash.h"
+#include "hamt.h"
 
 struct hashops	ops[] = {
-	{	"memhash",	/* type 0 */
+	[HASH_MEMHASH] = {
+		"memhash",	/* type 0 */
 		memhash_new,
 		0,		/* open */
 		0,		/* close */
@@ -33,8 +42,16 @@ struct hashops	ops[] = {
 		0,		/* last */
 		0,		/* prev */
 		memhash_count,
+		0,		/* fetchCopy */
+		memhash_fetchBatch,
+		memhash_storeBatch,
+		0,		/* seek */
+		memhash_reserve,
+		memhash_setop,
+		memhash_stats,
 	},
-	{	"u32",		/* type 1 */
+	[HASH_U32HASH] = {
+		"u32",		/* type 1 */
 		u32hash_new,
 		0,		/* open */
 		0,		/* close */
@@ -42,15 +59,23 @@ struct hashops	ops[] = {
 		u32hash_fetch,
 		u32hash_store,
 		u32hash_insert,
-		0,
+		u32hash_delete,
 		u32hash_first,
 		u32hash_next,
 		0,		/* last */
 		0,		/* prev */
 		u32hash_count,
+		0,		/* fetchCopy */
+		u32hash_fetchBatch,
+		u32hash_storeBatch,
+		0,		/* seek */
+		u32hash_reserve,
+		0,		/* setop */
+		u32hash_stats,
 	},
 #ifdef WRAPMEM
-	{	"mdbm",		/* type 2 */
+	[HASH_MDBM] = {
+		"mdbm",		/* type 2 */
 		wrapmdbm_new,
 		wrapmdbm_open,
 		wrapmdbm_close,
@@ -66,35 +91,252 @@ struct hashops	ops[] = {
 		0,		/* numelems */
 	},
 #endif
+	[HASH_SIMDHASH] = {
+		"simdhash",	/* type 3 */
+		simdhash_new,
+		0,		/* open */
+		0,		/* close */
+		simdhash_free,
+		simdhash_fetch,
+		simdhash_store,
+		simdhash_insert,
+		simdhash_delete,
+		simdhash_first,
+		simdhash_next,
+		0,		/* last */
+		0,		/* prev */
+		simdhash_count,
+		0,		/* fetchCopy */
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		0,		/* seek */
+		simdhash_reserve,
+		0,		/* setop */
+		simdhash_stats,
+	},
+	[HASH_U64HASH] = {
+		"u64",		/* type 4 */
+		u64hash_new,
+		0,		/* open */
+		0,		/* close */
+		u64hash_free,
+		u64hash_fetch,
+		u64hash_store,
+		u64hash_insert,
+		u64hash_delete,
+		u64hash_first,
+		u64hash_next,
+		0,		/* last */
+		0,		/* prev */
+		u64hash_count,
+		0,		/* fetchCopy */
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		0,		/* seek */
+		u64hash_reserve,
+		0,		/* setop */
+		u64hash_stats,
+	},
+	[HASH_CONCURRENT] = {
+		"concurrent",	/* type 5 */
+		conchash_new,
+		0,		/* open */
+		0,		/* close */
+		conchash_free,
+		conchash_fetch,
+		conchash_store,
+		conchash_insert,
+		conchash_delete,
+		conchash_first,
+		conchash_next,
+		0,		/* last */
+		0,		/* prev */
+		conchash_count,
+		conchash_fetchCopy,
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		0,		/* seek */
+		conchash_reserve,
+		0,		/* setop */
+		conchash_stats,
+	},
+	[HASH_MMAP] = {
+		"mmap",		/* type 6 */
+		0,		/* new */
+		frozenhash_open,
+		frozenhash_close,
+		frozenhash_close, /* free */
+		frozenhash_fetch,
+		frozenhash_store,
+		frozenhash_store, /* insert */
+		frozenhash_delete,
+		frozenhash_first,
+		frozenhash_next,
+		0,		/* last */
+		0,		/* prev */
+		frozenhash_count,
+		0,		/* fetchCopy */
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		0,		/* seek */
+		0,		/* reserve */
+		0,		/* setop */
+		frozenhash_stats,
+	},
+	[HASH_PERFECT] = {
+		"perfect",	/* type 7 */
+		perfhash_new,
+		0,		/* open */
+		0,		/* close */
+		perfhash_free,
+		perfhash_fetch,
+		perfhash_store,
+		perfhash_store,	/* insert */
+		perfhash_delete,
+		perfhash_first,
+		perfhash_next,
+		0,		/* last */
+		0,		/* prev */
+		perfhash_count,
+		0,		/* fetchCopy */
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		0,		/* seek */
+		0,		/* reserve */
+		0,		/* setop */
+		perfhash_stats,
+	},
+	[HASH_BTREE] = {
+		"btree",	/* type 8 */
+		btree_new,
+		0,		/* open */
+		0,		/* close */
+		btree_free,
+		btree_fetch,
+		btree_store,
+		btree_insert,
+		btree_delete,
+		btree_first,
+		btree_next,
+		btree_last,
+		btree_prev,
+		btree_count,
+		0,		/* fetchCopy */
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		btree_seek,
+		0,		/* reserve */
+		0,		/* setop */
+		btree_stats,
+	},
+	[HASH_STRHASH] = {
+		"strhash",	/* type 9 */
+		strhash_new,
+		0,		/* open */
+		0,		/* close */
+		strhash_free,
+		strhash_fetch,
+		strhash_store,
+		strhash_insert,
+		strhash_delete,
+		strhash_first,
+		strhash_next,
+		0,		/* last */
+		0,		/* prev */
+		strhash_count,
+		0,		/* fetchCopy */
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		0,		/* seek */
+		strhash_reserve,
+		0,		/* setop */
+		strhash_stats,
+	},
+	[HASH_HAMT] = {
+		"hamt",		/* type 10 */
+		hamt_new,
+		0,		/* open */
+		0,		/* close */
+		hamt_free,
+		hamt_fetch,
+		hamt_store,
+		hamt_insert,
+		hamt_delete,
+		hamt_first,
+		hamt_next,
+		0,		/* last */
+		0,		/* prev */
+		hamt_count,
+		hamt_fetchCopy,
+		0,		/* fetchBatch */
+		0,		/* storeBatch */
+		0,		/* seek */
+		0,		/* reserve */
+		0,		/* setop */
+		hamt_stats,
+		hamt_snapshot,
+	},
 };
 
 /*
  * Calls the initialize function for the underlying hash
  * function and returns a pointer to it.
+ * 'type' may have HASH_* options or'ed in, they are passed to
+ * the creation method separately.
  * Any arguments after 'type' are passed to the creation methods.
  *
  * methods:
- *   memhash_new wrapmdbm_new u32hash_new
+ *   memhash_new wrapmdbm_new u32hash_new simdhash_new u64hash_new
+ *   conchash_new perfhash_new btree_new strhash_new hamt_new
  */
 hash *
 hash_new(int type, ...)
 {
 	hash	*ret;
 	va_list	ap;
+	int	flags;
 
-	assert((type >= 0) && (type < (sizeof(ops)/sizeof(ops[0]))));
+	flags = type & ~HASH_TYPEMASK;
+	type &= HASH_TYPEMASK;
+	assert(type < (sizeof(ops)/sizeof(ops[0])));
+	assert(ops[type].hashnew);
 	va_start(ap, type);
-	ret = ops[type].hashnew(ap);
+	ret = ops[type].hashnew(flags, ap);
 	va_end(ap);
 	if (ret) ret->ops = &ops[type];
 	return (ret);
 }
 
+/*
+ * Like hash_new() but sized for 'n' keys, see hash_reserve().
+ * Any arguments after 'n' are passed to the creation method.
+ */
+hash *
+hash_newSized(int type, int n, ...)
+{
+	hash	*ret;
+	va_list	ap;
+	int	flags;
+
+	flags = type & ~HASH_TYPEMASK;
+	type &= HASH_TYPEMASK;
+	assert(type < (sizeof(ops)/sizeof(ops[0])));
+	assert(ops[type].hashnew);
+	va_start(ap, n);
+	ret = ops[type].hashnew(flags, ap);
+	va_end(ap);
+	if (ret) {
+		ret->ops = &ops[type];
+		hash_reserve(ret, n);
+	}
+	return (ret);
+}
+
 /*
  * Creates a new file-backed hash
  *
  * methods:
- *   wrapmdbm_open
+ *   wrapmdbm_open frozenhash_open
  */
 hash *
 hash_open(int type, char *file, int flags, mode_t mode, ...)
@@ -115,7 +357,7 @@ hash_open(int type, char *file, int flags, mode_t mode, ...)
  * Closes a file-backed hash
  *
  * methods:
- *   wrapmdbm_close
+ *   wrapmdbm_close frozenhash_close
  */
 int
 hash_close(hash *h)
@@ -133,7 +375,8 @@ hash_close(hash *h)
  * Free a hash.  Should only be called on hash's created with hash_new()
  *
  * methods:
- *   memhash_free wrapmdbm_free u32hash_free
+ *   memhash_free wrapmdbm_free u32hash_free simdhash_free u64hash_free
+ *   conchash_free perfhash_free btree_free strhash_free hamt_free
  */
 int
 hash_free(hash *h)
@@ -146,6 +389,79 @@ hash_free(hash *h)
 	return (ret);
 }
 
+/*
+ * Fetch n keys at once.  out[i] is set to the data for keys[i], or 0
+ * if that key isn't in the hash.  Backends with a batched method hash
+ * all keys first and prefetch the table before walking it, which is
+ * much faster than n hash_fetch() calls on a big table.
+ * h->kptr/h->vptr are undefined afterwards.
+ *
+ * Returns the number of keys found.
+ *
+ * methods:
+ *   memhash_fetchBatch u32hash_fetchBatch
+ */
+int
+hash_fetchBatch(hash *h, void **keys, int *klens, int n, void **out)
+{
+	int	i, found = 0;
+
+	assert(h);
+	if (h->ops->fetchBatch) {
+		return (h->ops->fetchBatch(h, keys, klens, n, out));
+	}
+	for (i = 0; i < n; i++) {
+		if ((out[i] = h->ops->fetch(h, keys[i], klens[i]))) ++found;
+	}
+	return (found);
+}
+
+/*
+ * Store n keys at once, like calling hash_store(h, keys[i], klens[i],
+ * vals[i], vlens[i]) for each.  If vals is 0 all the data is cleared.
+ * If out is set it gets the pointer returned by each store, but on
+ * backends where stores move data only the last one is sure to be
+ * valid.
+ *
+ * Returns the number of keys stored.
+ *
+ * methods:
+ *   memhash_storeBatch u32hash_storeBatch
+ */
+int
+hash_storeBatch(hash *h, void **keys, int *klens,
+    void **vals, int *vlens, int n, void **out)
+{
+	int	i;
+	void	*ret;
+
+	assert(h);
+	if (h->ops->storeBatch) {
+		return (h->ops->storeBatch(h, keys, klens, vals, vlens, n, out));
+	}
+	for (i = 0; i < n; i++) {
+		ret = h->ops->store(h, keys[i], klens[i],
+		    vals ? vals[i] : 0, vlens[i]);
+		if (out) out[i] = ret;
+	}
+	return (n);
+}
+
+/*
+ * Let the backend do a set operation if it knows how, which it
+ * usually can only when A and B are the same kind of hash.
+ * Returns -1 if the caller needs to do it the slow way.
+ *
+ * methods:
+ *   memhash_setop
+ */
+private int
+setop(int op, hash *A, hash *B, hash *C)
+{
+	unless (A->ops->setop) return (-1);
+	return (A->ops->setop(op, A, B, C));
+}
+
 /*
  * Compute C = A - B and return > 0 if items in C.
  */
@@ -155,6 +471,8 @@ hash_keyDiff3(hash *A, hash *B, hash *C)
         int     i = 0;
 
         assert(A && B && C);
+        if ((i = setop(HASH_SETDIFF, A, B, C)) >= 0) return (i);
+        i = 0;
         EACH_HASH(A) {
                 unless (hash_fetch(B, A->kptr, A->klen)) {
                         hash_store(C, A->kptr, A->klen, A->vptr, A->vlen);
@@ -170,7 +488,135 @@ hash_keyDiff3(hash *A, hash *B, hash *C)
 int
 hash_keyDiff(hash *A, hash *B)
 {
+        int     i;
+
         assert(A && B);
+        if ((i = setop(HASH_SETSUB, A, B, 0)) >= 0) return (i);
         EACH_HASH(B) hash_delete(A, B->kptr, B->klen);
         return (hash_first(A) != 0);
 }
+
+/*
+ * Compute C = A | B and return > 0 if items in C.
+ * Keys in both get their value from A.
+ */
+int
+hash_keyUnion(hash *A, hash *B, hash *C)
+{
+	int	i;
+
+	assert(A && B && C);
+	if ((i = setop(HASH_SETUNION, A, B, C)) >= 0) return (i);
+	EACH_HASH(A) hash_store(C, A->kptr, A->klen, A->vptr, A->vlen);
+	EACH_HASH(B) {
+		unless (hash_fetch(A, B->kptr, B->klen)) {
+			hash_store(C, B->kptr, B->klen, B->vptr, B->vlen);
+		}
+	}
+	return (hash_first(C) != 0);
+}
+
+/*
+ * Compute C = A & B, with the values from A, and return > 0 if
+ * items in C.
+ */
+int
+hash_keyIntersect(hash *A, hash *B, hash *C)
+{
+	int	i = 0;
+
+	assert(A && B && C);
+	if ((i = setop(HASH_SETINTERSECT, A, B, C)) >= 0) return (i);
+	i = 0;
+	EACH_HASH(A) {
+		if (hash_fetch(B, A->kptr, A->klen)) {
+			hash_store(C, A->kptr, A->klen, A->vptr, A->vlen);
+			i = 1;
+		}
+	}
+	return (i);
+}
+
+/*
+ * Compute A |= B, keeping A's value for keys in both, and return > 0
+ * if items in A.
+ */
+int
+hash_keyMerge(hash *A, hash *B)
+{
+	int	i;
+
+	assert(A && B);
+	if ((i = setop(HASH_SETMERGE, A, B, 0)) >= 0) return (i);
+	EACH_HASH(B) hash_insert(A, B->kptr, B->klen, B->vptr, B->vlen);
+	return (hash_first(A) != 0);
+}
+
+/*
+ * Fill in 's' with how full the hash is, how long the searches are
+ * and how much memory it uses.  This walks the whole table so it is
+ * meant for debugging and monitoring, not for every operation.
+ * Backends without a stats method only report the count.
+ *
+ * Returns 0
+ *
+ * methods:
+ *   memhash_stats u32hash_stats simdhash_stats u64hash_stats
+ *   conchash_stats frozenhash_stats perfhash_stats btree_stats
+ *   strhash_stats hamt_stats
+ */
+int
+hash_stats(hash *h, hashstats *s)
+{
+	assert(h && s);
+	memset(s, 0, sizeof(*s));
+	s->count = hash_count(h);
+	s->resizes = h->resizes;
+	s->resize_ns = h->resize_ns;
+	if (h->ops->stats) h->ops->stats(h, s);
+	if (s->slots) s->load = (double)s->count / s->slots;
+	return (0);
+}
+
+/*
+ * Print hash_stats() for 'h' to 'f', one "name: value" per line.
+ */
+void
+hash_printStats(hash *h, FILE *f)
+{
+	hashstats	s;
+
+	hash_stats(h, &s);
+	fprintf(f, "type: %s\n", h->ops->name);
+	fprintf(f, "count: %llu\n", s.count);
+	fprintf(f, "slots: %llu\n", s.slots);
+	fprintf(f, "load: %.3f\n", s.load);
+	fprintf(f, "maxprobe: %u\n", s.maxprobe);
+	fprintf(f, "meanprobe: %.3f\n", s.meanprobe);
+#ifdef	HASH_STATS
+	fprintf(f, "resizes: %u\n", s.resizes);
+	fprintf(f, "resize_ms: %.3f\n", s.resize_ns / 1e6);
+#endif
+	fprintf(f, "bytes: %llu\n", s.bytes);
+}
+
+/*
+ * Return a read-only copy of 'h' as it is now.  It can be read by
+ * other threads while 'h' keeps changing, and stays valid after 'h'
+ * is freed.  Free it with hash_free().
+ *
+ * Returns 0 with errno=ENOTSUP if the backend can't make snapshots.
+ *
+ * methods:
+ *   hamt_snapshot
+ */
+hash *
+hash_snapshot(hash *h)
+{
+	assert(h);
+	unless (h->ops->snapshot) {
+		errno = ENOTSUP;
+		return (0);
+	}
+	return (h->ops->snapshot(h));
+}
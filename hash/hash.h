@@ -23,6 +23,7 @@
 
 #include <stdarg.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
 #include <stdio.h>
@@ -30,15 +31,54 @@
 #include <stdlib.h>
 
 #include "style.h"
+#include "lines/data.h"
 
 typedef	struct	hash	hash;
 typedef	struct	hashops	hashops;
 
 #define	HASH_MEMHASH	0	/* a in-memory hash */
-#define	HASH_U32HASH	1	/* key is u32, val is fixed size, no deletes  */
+#define	HASH_U32HASH	1	/* key is u32, val is fixed size */
 #ifdef WRAPMDBM
 #define	HASH_MDBM	2	/* A file-based DB */
 #endif
+#define	HASH_SIMDHASH	3	/* open-addressing, probes 16 slots at once */
+#define	HASH_U64HASH	4	/* key is u64, val is fixed size and inline */
+#define	HASH_CONCURRENT	5	/* sharded memhash, usable from many threads */
+#define	HASH_MMAP	6	/* read-only, mmap of a hash_toFrozen() file */
+#define	HASH_PERFECT	7	/* read-only, perfect hash, see hash_freeze() */
+#define	HASH_BTREE	8	/* B+tree, keys kept in sorted order */
+#define	HASH_STRHASH	9	/* short keys stored inline, no node per key */
+#define	HASH_HAMT	10	/* trie with cheap snapshots, see hash_snapshot() */
+
+/*
+ * Options that can be or'ed with the type passed to hash_new().
+ * Backends ignore the options that don't apply to them.
+ */
+#define	HASH_TYPEMASK	0x000000ff
+#define	HASH_ARENA	0x00000100	/* memhash: nodes come from an arena */
+#define	HASH_INCREMENTAL 0x00000200	/* memhash, u32hash: resize a little
+					 * at a time instead of all at once */
+
+/*
+ * HASH_CONCURRENT splits its keys across a power of 2 number of
+ * shards, HASH_SHARDS(n) asks for at least n (up to 4095).  Without
+ * it a default is used.
+ */
+#define	HASH_SHARDMASK	0x0fff0000
+#define	HASH_SHARDS(n)	(((n) << 16) & HASH_SHARDMASK)
+
+/*
+ * The function used to hash keys can also be picked.  By default
+ * (HASH_FN_DEFAULT) memhash and simdhash use HASH_FN_WY for keys of
+ * 16 bytes or less and HASH_FN_CRC32C for longer ones, and u32hash
+ * and u64hash use HASH_FN_INT.  hash_toFrozen() files always use
+ * crc32c.
+ */
+#define	HASH_FNMASK	0x0000f000
+#define	HASH_FN_DEFAULT	0x00000000
+#define	HASH_FN_CRC32C	0x00001000	/* crc32c, hardware when available */
+#define	HASH_FN_WY	0x00002000	/* 64-bit multiply, for short keys */
+#define	HASH_FN_INT	0x00003000	/* integer mix, for u32/u64 keys */
 
 /*
  * User visible hash struct.  This contains the ops struct with the per-class
@@ -51,8 +91,52 @@ struct hash {
 	int	klen;
 	void	*vptr;
 	int	vlen;
+	u32	resizes;	/* HASH_STATS: times the table was resized */
+	u64	resize_ns;	/* HASH_STATS: time spent resizing */
 };
 
+/*
+ * What hash_stats() returns.  A probe is one key or slot looked at
+ * while searching, so a key found in its first slot or at the head of
+ * its chain takes 1 probe.
+ */
+typedef	struct {
+	u64	count;		/* number of keys */
+	u64	slots;		/* buckets or slots in the table */
+	double	load;		/* count / slots */
+	u32	maxprobe;	/* most probes to find any key */
+	double	meanprobe;	/* average probes to find a key */
+	u32	resizes;	/* HASH_STATS only, else 0 */
+	u64	resize_ns;	/* HASH_STATS only, else 0 */
+	u64	bytes;		/* memory used, about */
+} hashstats;
+
+/*
+ * Build with -DHASH_STATS to have the backends count their resizes
+ * and the time spent in them:
+ *	STATS_START(t);
+ *	... resize ...
+ *	STATS_END(h, t);
+ */
+#ifdef	HASH_STATS
+#include <time.h>
+
+private inline u64
+hash_nsec(void)
+{
+	struct	timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u64)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+#define	STATS_START(t)	u64 t = hash_nsec()
+#define	STATS_END(h, t)	\
+	((h)->resizes++, (h)->resize_ns += hash_nsec() - (t))
+#else
+#define	STATS_START(t)
+#define	STATS_END(h, t)
+#endif
+
 /*
  * Users should not call these functions directly, but instead called the
  * hash_XXX() methods below.
@@ -64,7 +148,7 @@ struct hash {
  */
 struct hashops {
 	char	*name;
-	hash	*(*hashnew)(va_list ap);
+	hash	*(*hashnew)(int flags, va_list ap);
 	hash	*(*hashopen)(char *file, int flags, mode_t mode, va_list ap);
 	int	(*hashclose)(hash *h);
 	int	(*free)(hash *h);
@@ -77,11 +161,22 @@ struct hashops {
 	void	*(*last)(hash *h);
 	void	*(*prev)(hash *h);
 	int	(*count)(hash *h);
+	int	(*fetchCopy)(hash *h, void *key, int klen, void *vbuf, int vsize);
+	int	(*fetchBatch)(hash *h, void **keys, int *klens, int n,
+		    void **out);
+	int	(*storeBatch)(hash *h, void **keys, int *klens,
+		    void **vals, int *vlens, int n, void **out);
+	void	*(*seek)(hash *h, void *key, int klen);
+	int	(*reserve)(hash *h, int n);
+	int	(*setop)(int op, hash *A, hash *B, hash *C);
+	int	(*stats)(hash *h, hashstats *s);
+	hash	*(*snapshot)(hash *h);
 };
 
 
 /* Create a new in-memory hash (see hash.c) */
 hash	*hash_new(int type, ...);
+hash	*hash_newSized(int type, int n, ...);
 int	hash_free(hash *h);
 
 /* Create a new file-based hash (see hash.c) */
@@ -103,7 +198,9 @@ int	hash_close(hash *h);
  *   operation that modifies the hash. (store/insert/delete).
  *
  * methods:
- *   memhash_fetch wrapmdbm_fetch u32hash_fetch
+ *   memhash_fetch wrapmdbm_fetch u32hash_fetch simdhash_fetch
+ *   u64hash_fetch conchash_fetch frozenhash_fetch
+ *   perfhash_fetch btree_fetch strhash_fetch hamt_fetch
  */
 private inline void *
 hash_fetch(hash *h, void *key, int klen)
@@ -115,6 +212,42 @@ hash_fetch(hash *h, void *key, int klen)
 	return (h->ops->fetch(h, key, klen));
 }
 
+/*
+ * Fetch a copy of the data stored under key
+ *
+ * Like hash_fetch(), but the data is copied into the caller's buffer
+ * 'vbuf' (at most 'vsize' bytes) instead of returning a pointer into
+ * the hash, and h->kptr/h->vptr are not used.  This is the way to
+ * fetch from a hash shared by several threads.  vbuf may be 0 to just
+ * get the length.
+ *
+ * Returns:
+ *   the length of the data in the hash (which may be more than vsize),
+ *   or -1 with errno=ENOENT if the key was not found.
+ *
+ * methods:
+ *   conchash_fetchCopy hamt_fetchCopy
+ *   Backends without the method use hash_fetch(), which is fine for
+ *   hashes that are only used by one thread.
+ */
+private inline int
+hash_fetchCopy(hash *h, void *key, int klen, void *vbuf, int vsize)
+{
+	unless (h) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (h->ops->fetchCopy) {
+		return (h->ops->fetchCopy(h, key, klen, vbuf, vsize));
+	}
+	unless (h->ops->fetch(h, key, klen)) {
+		errno = ENOENT;
+		return (-1);
+	}
+	if (vbuf) memcpy(vbuf, h->vptr, min(h->vlen, vsize));
+	return (h->vlen);
+}
+
 /*
  * Store a data item into hash under key replacing any existing data.
  *
@@ -127,7 +260,9 @@ hash_fetch(hash *h, void *key, int klen)
  *   pointer to where 'val' was stored in the hash, or NULL for error.
  *
  * methods:
- *   memhash_store wrapmdbm_store u32hash_store
+ *   memhash_store wrapmdbm_store u32hash_store simdhash_store
+ *   u64hash_store conchash_store frozenhash_store
+ *   perfhash_store btree_store strhash_store hamt_store
  */
 private inline void *
 hash_store(hash *h, void *key, int klen, void *val, int vlen)
@@ -150,7 +285,9 @@ hash_store(hash *h, void *key, int klen, void *val, int vlen)
  *   exists.
  *
  * methods:
- *   memhash_insert wrapmdbm_insert u32hash_insert
+ *   memhash_insert wrapmdbm_insert u32hash_insert simdhash_insert
+ *   u64hash_insert conchash_insert frozenhash_store
+ *   perfhash_store btree_insert strhash_insert hamt_insert
  */
 private inline void *
 hash_insert(hash *h, void *key, int klen, void *val, int vlen)
@@ -167,7 +304,9 @@ hash_insert(hash *h, void *key, int klen, void *val, int vlen)
  *    0 if key was deleted successfully
  *
  * methods:
- *   memhash_delete wrapmdbm_delete
+ *   memhash_delete wrapmdbm_delete u32hash_delete simdhash_delete
+ *   u64hash_delete conchash_delete frozenhash_delete
+ *   perfhash_delete btree_delete strhash_delete hamt_delete
  */
 private inline int
 hash_delete(hash *h, void *key, int klen)
@@ -188,7 +327,9 @@ hash_delete(hash *h, void *key, int klen)
  *   A pointer to the data for the first item, or NULL if the hash is empty.
  *
  * methods:
- *   memhash_first wrapmdbm_first u32hash_first
+ *   memhash_first wrapmdbm_first u32hash_first simdhash_first
+ *   u64hash_first conchash_first frozenhash_first
+ *   perfhash_first btree_first strhash_first hamt_first
  */
 private inline void *
 hash_first(hash *h)
@@ -206,7 +347,9 @@ hash_first(hash *h)
  *   A pointer to the data for that item, or NULL of no items remain in hash.
  *
  * methods:
- *   memhash_next wrapmdbm_next u32hash_next
+ *   memhash_next wrapmdbm_next u32hash_next simdhash_next
+ *   u64hash_next conchash_next frozenhash_next
+ *   perfhash_next btree_next strhash_next hamt_next
  */
 private inline void *
 hash_next(hash *h)
@@ -218,8 +361,11 @@ hash_next(hash *h)
 /*
  * see hash_first
  *
+ * Only for ordered hashes, where hash_last() finds the last key and
+ * hash_prev() walks backwards from there.
+ *
  * methods:
- *   RBtree_last
+ *   btree_last
  */
 private inline void *
 hash_last(hash *h)
@@ -232,7 +378,7 @@ hash_last(hash *h)
  * see hash_next
  *
  * methods:
- *   RBtree_prev
+ *   btree_prev
  */
 private inline void *
 hash_prev(hash *h)
@@ -241,6 +387,56 @@ hash_prev(hash *h)
 	return (h->ops->prev(h));
 }
 
+/*
+ * Position an ordered hash at the first key >= (key,klen)
+ *
+ * Sets the pointers in 'h' to that item and hash_next() or hash_prev()
+ * continue from there, so a range or prefix scan is:
+ *
+ *   for (hash_seek(h, "dir/", 4); h->kptr; hash_next(h)) {
+ *           unless (strneq(h->kptr, "dir/", 4)) break;
+ *           ...
+ *   }
+ *
+ * Returns:
+ *   A pointer to the data for that item, or NULL if no key is >= key.
+ *   NULL with errno=ENOTSUP if the hash isn't ordered.
+ *
+ * methods:
+ *   btree_seek
+ */
+private inline void *
+hash_seek(hash *h, void *key, int klen)
+{
+	unless (h && h->ops->seek) {
+		errno = ENOTSUP;
+		return (0);
+	}
+	return (h->ops->seek(h, key, klen));
+}
+
+/*
+ * Make room for 'n' keys in total
+ *
+ * A hint that the hash will grow to 'n' keys so it can be sized once
+ * instead of growing through every doubling.  Backends that don't
+ * need it ignore it.
+ *
+ * Returns:
+ *   0
+ *
+ * methods:
+ *   memhash_reserve u32hash_reserve simdhash_reserve u64hash_reserve
+ *   conchash_reserve strhash_reserve
+ */
+private inline int
+hash_reserve(hash *h, int n)
+{
+	assert(h);
+	unless (h->ops->reserve) return (0);
+	return (h->ops->reserve(h, n));
+}
+
 /*
  * Walk all items in hash
  */
@@ -265,6 +461,7 @@ hash_count(hash *h)
 }
 
 char	*hash_toStr(hash *h);
+void	hash_toStrData(hash *h, DATA *d);
 int	hash_fromStr(hash *h, char *str);
 void	hash_keyencode(FILE *out, u8 *ptr);
 char	*hash_keydecode(char *key);
@@ -272,8 +469,29 @@ int	hash_toStream(hash *h, FILE *f);
 hash	*hash_fromStream(hash *h, FILE *f);
 int	hash_toFile(hash *h, char *path);
 hash	*hash_fromFile(hash *h, char *path);
+int	hash_toBinStream(hash *h, FILE *f, int flags);
+int	hash_toBinFile(hash *h, char *path, int flags);
+#define	HASH_BIN_SORTED	0x01	/* write keys in sorted order */
+int	hash_toFrozen(hash *h, char *path);
+hash	*hash_freeze(hash *h);
+int	hash_fetchBatch(hash *h, void **keys, int *klens, int n, void **out);
+int	hash_storeBatch(hash *h, void **keys, int *klens,
+	    void **vals, int *vlens, int n, void **out);
 int	hash_keyDiff3(hash *A, hash *B, hash *C);
 int	hash_keyDiff(hash *A, hash *B);
+int	hash_keyUnion(hash *A, hash *B, hash *C);
+int	hash_keyIntersect(hash *A, hash *B, hash *C);
+int	hash_keyMerge(hash *A, hash *B);
+int	hash_stats(hash *h, hashstats *s);
+hash	*hash_snapshot(hash *h);
+void	hash_printStats(hash *h, FILE *f);
+
+/* ops->setop() operations, for the hash_key*() functions above */
+#define	HASH_SETDIFF		1	/* C = A - B */
+#define	HASH_SETINTERSECT	2	/* C = A & B */
+#define	HASH_SETUNION		3	/* C = A | B */
+#define	HASH_SETSUB		4	/* A -= B */
+#define	HASH_SETMERGE		5	/* A |= B */
 
 /* internal state for hash_parseLine */
 typedef	struct {
@@ -303,6 +521,7 @@ int	hash_parseLine(char *line, hash *h, hashpl *data);
  *   Mem  start/len  like memcpy
  *   I32  i32
  *   U32  u32
+ *   U64  u64
  *   Num  int stored as a decimal string
  *   Set  no data, hash is a set of keys-only
  *
@@ -568,4 +787,67 @@ hash_deleteU32(hash *h, u32 key)
 	return (h->ops->delete(h, &key, sizeof(key)));
 }
 
+private inline u64
+hash_fetchU64U64(hash *h, u64 key)
+{
+	unless (h) {
+		errno = EINVAL;
+		return (0);
+	}
+	if (h->ops->fetch(h, &key, sizeof(key))) {
+		return (*(u64 *)h->vptr);
+	} else {
+		/*
+		 * Return 0 when the key isn't found.  The user can
+		 * test h->kptr to distingush from a real 0 stored in
+		 * the hash.
+		 */
+		return (0);
+	}
+}
+
+private inline void *
+hash_fetchU64Ptr(hash *h, u64 key)
+{
+	void	**data;
+
+	unless (h) {
+		errno = EINVAL;
+		return (0);
+	}
+	if ((data = h->ops->fetch(h, &key, sizeof(key)))) {
+		return (*data);
+	} else {
+		return (0);
+	}
+}
+
+private inline u64 *
+hash_insertU64U64(hash *h, u64 key, u64 val)
+{
+	assert(h);
+	return (h->ops->insert(h, &key, sizeof(key), &val, sizeof(val)));
+}
+
+private inline u64 *
+hash_storeU64U64(hash *h, u64 key, u64 val)
+{
+	assert(h);
+	return (h->ops->store(h, &key, sizeof(key), &val, sizeof(val)));
+}
+
+private inline void **
+hash_storeU64Ptr(hash *h, u64 key, void *val)
+{
+	assert(h);
+	return (h->ops->store(h, &key, sizeof(key), &val, sizeof(val)));
+}
+
+private inline int
+hash_deleteU64(hash *h, u64 key)
+{
+	assert(h);
+	return (h->ops->delete(h, &key, sizeof(key)));
+}
+
 #endif
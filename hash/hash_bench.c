@@ -0,0 +1,417 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash/hash.h"
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "lines/lines.h"
+
+/*
+ * Time the hash backends.
+ *
+ * For every backend, key shape and table size this builds a hash of
+ * n keys and reports the ns/op of insert, a fetch that finds its key,
+ * a fetch that doesn't, delete, iteration and hash_toBinStream(), the
+ * last two per key.  Small tables are rebuilt until about MINOPS
+ * keys have been timed.  mem/key is what hash_stats() says the hash
+ * uses and rss/key is how much the process grew while inserting.
+ * Each run is done in its own process so memory freed by one run
+ * doesn't hide the growth of the next.
+ *
+ * Key shapes:
+ *   path	pathnames like "src/lib17/hash/file123.c", with the null
+ *   binary	16 random bytes
+ *   seq	sequential u32s (u64s for u64hash); the only keys
+ *		u32hash and u64hash take
+ *   zipf	pathnames, fetched with a zipfian distribution so a few
+ *		keys get most of the lookups
+ *
+ * The default table sizes go from the L1 data cache to 10 times the
+ * last level cache, assuming BYTES_PER_KEY per key.
+ */
+
+#define	MINOPS		(1 << 20)
+#define	BYTES_PER_KEY	64
+#define	KSTRIDE		48		/* room for the longest key */
+
+typedef struct {
+	char	*name;
+	int	type;
+	int	klen;		/* key length the backend needs, or 0 */
+} backend;
+
+private	backend	backends[] = {
+	{"memhash",	HASH_MEMHASH,	0},
+	{"u32hash",	HASH_U32HASH,	sizeof(u32)},
+	{"u64hash",	HASH_U64HASH,	sizeof(u64)},
+	{"simdhash",	HASH_SIMDHASH,	0},
+	{"strhash",	HASH_STRHASH,	0},
+	{"hamt",	HASH_HAMT,	0},
+	{"btree",	HASH_BTREE,	0},
+	{"concurrent",	HASH_CONCURRENT, 0},
+	{0}
+};
+
+private	char	*shapes[] = {"path", "binary", "seq", "zipf", 0};
+
+typedef struct {
+	u32	n;		/* keys in the hash */
+	char	*buf;		/* 2n keys, the last n are never stored */
+	int	*len;
+	u32	*order;		/* key to fetch for each hit */
+} keyset;
+
+typedef struct {
+	double	insert, hit, miss, delete, iter, serial;
+	double	mem, rss;
+} result;
+
+private	u64	seed = 1;
+
+private u64
+rnd(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return (seed * 0x2545f4914f6cdd1dULL);
+}
+
+private u64
+nsec(void)
+{
+	struct	timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * Resident size in bytes, or 0 if we can't tell.
+ */
+private u64
+rss(void)
+{
+	FILE	*f;
+	unsigned long	size, res = 0;
+
+	if ((f = fopen("/proc/self/statm", "r"))) {
+		if (fscanf(f, "%lu %lu", &size, &res) != 2) res = 0;
+		fclose(f);
+	}
+	return ((u64)res * sysconf(_SC_PAGESIZE));
+}
+
+#define	KEY(ks, i)	((ks)->buf + (u64)(i) * KSTRIDE)
+
+private void
+mkkeys(keyset *ks, char *shape, int klen)
+{
+	char	*dirs[] = {"src", "lib", "doc", "gui", "utils", "hash",
+	    "lines", "tests"};
+	double	*cdf = 0;
+	u64	r;
+	u32	i, j, lo, hi;
+
+	ks->buf = malloc((u64)2 * ks->n * KSTRIDE);
+	ks->len = malloc(2 * ks->n * sizeof(int));
+	ks->order = malloc(ks->n * sizeof(u32));
+	for (i = 0; i < 2 * ks->n; i++) {
+		r = rnd();
+		if (streq(shape, "binary")) {
+			memcpy(KEY(ks, i), &r, 8);
+			r = rnd();
+			memcpy(KEY(ks, i) + 8, &r, 8);
+			ks->len[i] = 16;
+		} else if (streq(shape, "seq")) {
+			r = i + 1;
+			memcpy(KEY(ks, i), &r, sizeof(r));
+			ks->len[i] = klen ? klen : sizeof(u32);
+		} else {
+			ks->len[i] = sprintf(KEY(ks, i), "%s/%s%u/%s/file%u.c",
+			    dirs[r & 7], dirs[(r >> 3) & 7], (u32)(r >> 8) % 100,
+			    dirs[(r >> 16) & 7], i) + 1;
+		}
+	}
+
+	/* the order of the hits */
+	if (streq(shape, "zipf")) {
+		cdf = malloc(ks->n * sizeof(double));
+		for (i = 0; i < ks->n; i++) {
+			cdf[i] = (i ? cdf[i-1] : 0) + 1.0 / (i + 1);
+		}
+		for (i = 0; i < ks->n; i++) {
+			double	u = (rnd() >> 11) * 0x1p-53 * cdf[ks->n - 1];
+
+			lo = 0;
+			hi = ks->n - 1;
+			while (lo < hi) {
+				j = lo + (hi - lo) / 2;
+				if (cdf[j] < u) {
+					lo = j + 1;
+				} else {
+					hi = j;
+				}
+			}
+			ks->order[i] = lo;
+		}
+		free(cdf);
+	} else {
+		for (i = 0; i < ks->n; i++) ks->order[i] = i;
+		for (i = ks->n - 1; i > 0; i--) {
+			j = rnd() % (i + 1);
+			r = ks->order[i];
+			ks->order[i] = ks->order[j];
+			ks->order[j] = r;
+		}
+	}
+}
+
+private hash *
+newhash(backend *b)
+{
+	switch (b->type) {
+	    case HASH_U32HASH:
+		return (hash_new(b->type, sizeof(u32), sizeof(u64)));
+	    case HASH_U64HASH:
+		return (hash_new(b->type, sizeof(u64), sizeof(u64)));
+	    default:
+		return (hash_new(b->type));
+	}
+}
+
+private void
+run(backend *b, keyset *ks, result *res)
+{
+	hash	*h;
+	hashstats	st;
+	FILE	*null;
+	u64	t0, base, v;
+	u32	i, n = ks->n;
+	int	rep, reps;
+	volatile	u64	sink = 0;
+
+	unless (null = fopen("/dev/null", "w")) {
+		perror("/dev/null");
+		exit(1);
+	}
+	memset(res, 0, sizeof(*res));
+	reps = (n < MINOPS) ? MINOPS / n : 1;
+	for (rep = 0; rep < reps; rep++) {
+		h = newhash(b);
+		base = rss();
+		t0 = nsec();
+		for (i = 0; i < n; i++) {
+			v = i;
+			hash_insert(h, KEY(ks, i), ks->len[i], &v, sizeof(v));
+		}
+		res->insert += nsec() - t0;
+		unless (rep) {
+			res->rss = (double)(rss() - base) / n;
+			hash_stats(h, &st);
+			res->mem = (double)st.bytes / n;
+		}
+		assert(hash_count(h) == n);
+
+		t0 = nsec();
+		for (i = 0; i < n; i++) {
+			u32	k = ks->order[i];
+
+			sink += (u64)hash_fetch(h, KEY(ks, k), ks->len[k]);
+		}
+		res->hit += nsec() - t0;
+
+		t0 = nsec();
+		for (i = n; i < 2 * n; i++) {
+			if (hash_fetch(h, KEY(ks, i), ks->len[i])) {
+				fprintf(stderr, "%s: found a missing key\n",
+				    b->name);
+				exit(1);
+			}
+		}
+		res->miss += nsec() - t0;
+
+		t0 = nsec();
+		EACH_HASH(h) sink += h->klen;
+		res->iter += nsec() - t0;
+
+		t0 = nsec();
+		hash_toBinStream(h, null, 0);
+		fflush(null);
+		res->serial += nsec() - t0;
+
+		t0 = nsec();
+		for (i = 0; i < n; i++) {
+			hash_delete(h, KEY(ks, i), ks->len[i]);
+		}
+		res->delete += nsec() - t0;
+		assert(hash_count(h) == 0);
+		hash_free(h);
+	}
+	fclose(null);
+	n *= reps;
+	res->insert /= n;
+	res->hit /= n;
+	res->miss /= n;
+	res->delete /= n;
+	res->iter /= n;
+	res->serial /= n;
+}
+
+/*
+ * Do one row of the table in a child process.
+ */
+private void
+bench(backend *b, char *shape, u32 n)
+{
+	keyset	ks;
+	result	res;
+	pid_t	pid;
+	int	status;
+
+	fflush(stdout);
+	if ((pid = fork()) < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid) {
+		waitpid(pid, &status, 0);
+		unless (WIFEXITED(status) && !WEXITSTATUS(status)) {
+			fprintf(stderr, "%s %s %u: failed\n", b->name, shape, n);
+		}
+		return;
+	}
+	ks.n = n;
+	mkkeys(&ks, shape, b->klen);
+	run(b, &ks, &res);
+	printf("%-10s %-6s %9u %7.1f %7.1f %7.1f %7.1f %7.1f %7.1f "
+	    "%7.1f %7.1f\n",
+	    b->name, shape, n, res.insert, res.hit, res.miss, res.delete,
+	    res.iter, res.serial, res.mem, res.rss);
+	exit(0);
+}
+
+/*
+ * Size of the data cache at 'level', or 'dflt' if we can't tell.
+ */
+private u64
+cachesize(int level, u64 dflt)
+{
+	long	n = -1;
+
+#ifdef	_SC_LEVEL1_DCACHE_SIZE
+	switch (level) {
+	    case 1: n = sysconf(_SC_LEVEL1_DCACHE_SIZE); break;
+	    case 2: n = sysconf(_SC_LEVEL2_CACHE_SIZE); break;
+	    case 3: n = sysconf(_SC_LEVEL3_CACHE_SIZE); break;
+	}
+#endif
+	return ((n > 0) ? n : dflt);
+}
+
+private int
+want(char **list, char *name)
+{
+	int	i;
+
+	unless (list) return (1);
+	EACH(list) if (streq(list[i], name)) return (1);
+	return (0);
+}
+
+int
+main(int ac, char **av)
+{
+	int	c, i, j;
+	char	**types = 0, **keys = 0, **sizes = 0;
+	u32	*n = 0;
+	int	nsizes;
+	backend	*b;
+
+	while ((c = getopt(ac, av, "k:n:r:t:")) != -1) {
+		switch (c) {
+		    case 'k': keys = splitLine(optarg, ",", keys); break;
+		    case 'n': sizes = splitLine(optarg, ",", sizes); break;
+		    case 'r': seed = strtoull(optarg, 0, 0) | 1; break;
+		    case 't': types = splitLine(optarg, ",", types); break;
+		    default: goto usage;
+		}
+	}
+	if (optind < ac) {
+usage:		fprintf(stderr, "usage: hash_bench [-k shapes] [-n sizes] "
+		    "[-r seed] [-t types]\n");
+		return (1);
+	}
+	EACH(types) {
+		for (b = backends; b->name; b++) {
+			if (streq(b->name, types[i])) break;
+		}
+		unless (b->name) {
+			fprintf(stderr, "hash_bench: unknown type %s\n",
+			    types[i]);
+			goto usage;
+		}
+	}
+	EACH(keys) {
+		for (j = 0; shapes[j]; j++) {
+			if (streq(shapes[j], keys[i])) break;
+		}
+		unless (shapes[j]) {
+			fprintf(stderr, "hash_bench: unknown shape %s\n",
+			    keys[i]);
+			goto usage;
+		}
+	}
+	if (sizes) {
+		nsizes = nLines(sizes);
+		n = malloc(nsizes * sizeof(u32));
+		EACH(sizes) {
+			char	*p;
+
+			n[i-1] = strtoul(sizes[i], &p, 0);
+			if (*p == 'k') n[i-1] <<= 10;
+			if (*p == 'm') n[i-1] <<= 20;
+			unless (n[i-1]) goto usage;
+		}
+	} else {
+		/* L1 to 10 x the last level cache */
+		nsizes = 4;
+		n = malloc(nsizes * sizeof(u32));
+		n[0] = cachesize(1, 32 << 10) / BYTES_PER_KEY;
+		n[1] = cachesize(2, 1 << 20) / BYTES_PER_KEY;
+		n[2] = cachesize(3, (u64)n[1] * BYTES_PER_KEY) / BYTES_PER_KEY;
+		n[3] = 10 * n[2];
+	}
+
+	printf("%-10s %-6s %9s %7s %7s %7s %7s %7s %7s %7s %7s\n",
+	    "type", "shape", "n", "insert", "hit", "miss", "delete",
+	    "iter", "serial", "mem/key", "rss/key");
+	for (b = backends; b->name; b++) {
+		unless (want(types, b->name)) continue;
+		for (j = 0; shapes[j]; j++) {
+			unless (want(keys, shapes[j])) continue;
+			/* the integer hashes only take integer keys */
+			if (b->klen && !streq(shapes[j], "seq")) continue;
+			for (i = 0; i < nsizes; i++) bench(b, shapes[j], n[i]);
+		}
+	}
+	freeLines(types, free);
+	freeLines(keys, free);
+	freeLines(sizes, free);
+	free(n);
+	return (0);
+}
@@ -4,6 +4,367 @@
 #include "utils/base64.h"
 #include "utils/webencode.h"
 
+#define	NKEYS	5000
+
+/*
+ * Key 'i' for a hash with 'klen' byte integer keys, or a C string
+ * key if klen is 0.  Half of the string keys are longer than 16
+ * bytes so both default hash functions get used.
+ */
+private int
+mkkey(int klen, int i, char *buf)
+{
+	switch (klen) {
+	    case sizeof(u32):
+		*(u32 *)buf = i + 1;	/* 0 can't be a u32hash key */
+		return (klen);
+	    case sizeof(u64):
+		*(u64 *)buf = ((u64)i << 32) | i;
+		return (klen);
+	}
+	return (sprintf(buf, "%s/key%d",
+	    (i & 1) ? "a/longer/dir" : "d", i) + 1);
+}
+
+/*
+ * Data for key 'i', the 'gen'th time it is stored.  Fixed size if
+ * 'vlen' is set, else a string that changes length with 'gen'.
+ */
+private int
+mkval(int vlen, int i, int gen, char *buf)
+{
+	switch (vlen) {
+	    case sizeof(u32):
+		*(u32 *)buf = i * 31 + gen;
+		return (vlen);
+	    case sizeof(u64):
+		*(u64 *)buf = ((u64)gen << 32) | i;
+		return (vlen);
+	}
+	return (sprintf(buf, "val%d%.*s",
+	    i, gen * 10, "0123456789abcdefghij") + 1);
+}
+
+/*
+ * Check 'a' and 'b' hold the same keys and data.
+ */
+private void
+sameHash(hash *a, hash *b)
+{
+	void	*v;
+	int	n = 0;
+
+	EACH_HASH(a) {
+		++n;
+		assert((v = hash_fetch(b, a->kptr, a->klen)));
+		assert((b->vlen == a->vlen) && !memcmp(v, a->vptr, a->vlen));
+	}
+	assert((n == hash_count(a)) && (n == hash_count(b)));
+}
+
+/*
+ * Run the same inserts, stores and deletes on a hash of 'type' and on
+ * a memhash and check they end up the same.  'klen' and 'vlen' are
+ * the fixed sizes for the integer hashes, else 0.
+ */
+private void
+backend_test(int type, int klen, int vlen)
+{
+	hash	*h, *ref;
+	int	i, kl, vl;
+	char	key[64], val[64];
+	void	*keys[64], *out[64];
+	int	klens[64];
+	char	kbuf[64][64];
+	void	*v;
+
+	if (klen) {
+		h = hash_new(type, klen, vlen);
+	} else {
+		h = hash_new(type);
+	}
+	ref = hash_new(HASH_MEMHASH);
+	for (i = 0; i < NKEYS; i++) {
+		kl = mkkey(klen, i, key);
+		vl = mkval(vlen, i, 0, val);
+		assert((v = hash_insert(h, key, kl, val, vl)));
+		assert(!memcmp(v, val, vl));
+		assert(hash_insert(ref, key, kl, val, vl));
+		assert(!hash_insert(h, key, kl, val, vl));
+	}
+	sameHash(h, ref);
+	for (i = 0; i < NKEYS; i += 3) {
+		kl = mkkey(klen, i, key);
+		vl = mkval(vlen, i, 1, val);
+		assert(hash_store(h, key, kl, val, vl));
+		hash_store(ref, key, kl, val, vl);
+	}
+	for (i = 0; i < NKEYS; i += 5) {
+		kl = mkkey(klen, i, key);
+		assert(!hash_delete(h, key, kl));
+		assert(hash_delete(h, key, kl) == -1);
+		hash_delete(ref, key, kl);
+	}
+	for (i = NKEYS; i < NKEYS + 100; i++) {
+		kl = mkkey(klen, i, key);
+		assert(!hash_fetch(h, key, kl));
+	}
+	sameHash(h, ref);
+	sameHash(ref, h);
+	kl = mkkey(klen, 1, key);
+	vl = mkval(vlen, 1, 0, val);
+	assert(hash_fetchCopy(h, key, kl, kbuf[0], sizeof(kbuf[0])) == vl);
+	assert(!memcmp(kbuf[0], val, vl));
+	kl = mkkey(klen, 0, key);
+	assert(hash_fetchCopy(h, key, kl, 0, 0) == -1);
+
+	/* keys 0..63 with every 5th deleted */
+	for (i = 0; i < 64; i++) {
+		keys[i] = kbuf[i];
+		klens[i] = mkkey(klen, i, kbuf[i]);
+	}
+	assert(hash_fetchBatch(h, keys, klens, 64, out) == 64 - 13);
+	for (i = 0; i < 64; i++) {
+		if (i % 5) {
+			assert(out[i]);
+			assert(out[i] == hash_fetch(h, keys[i], klens[i]));
+		} else {
+			assert(!out[i]);
+		}
+	}
+	hash_free(h);
+	hash_free(ref);
+}
+
+/*
+ * Write a memhash, a btree sorted and a u64hash to one binary stream
+ * and read them back.
+ */
+private void
+stream_test(void)
+{
+	hash	*h[3], *h2;
+	FILE	*f;
+	int	i, j, kl, vl;
+	char	key[64], val[64];
+
+	h[0] = hash_new(HASH_MEMHASH);
+	h[1] = hash_new(HASH_BTREE);
+	h[2] = hash_new(HASH_U64HASH, sizeof(u64), sizeof(u64));
+	for (i = 0; i < NKEYS; i++) {
+		for (j = 0; j < 3; j++) {
+			kl = mkkey((j == 2) ? sizeof(u64) : 0, i, key);
+			vl = mkval((j == 2) ? sizeof(u64) : 0, i, j, val);
+			hash_insert(h[j], key, kl, val, vl);
+		}
+	}
+	f = tmpfile();
+	assert(!hash_toBinStream(h[0], f, 0));
+	assert(!hash_toBinStream(h[1], f, HASH_BIN_SORTED));
+	assert(!hash_toBinStream(h[2], f, HASH_BIN_SORTED));
+	rewind(f);
+	for (j = 0; j < 3; j++) {
+		/* the btree is read back into a btree, the others a memhash */
+		h2 = hash_fromStream((j == 1) ? hash_new(HASH_BTREE) : 0, f);
+		assert(h2);
+		sameHash(h[j], h2);
+		sameHash(h2, h[j]);
+		hash_free(h2);
+		hash_free(h[j]);
+	}
+	assert(!hash_fromStream(0, f));
+	fclose(f);
+}
+
+/*
+ * hash_toFrozen() + hash_open(HASH_MMAP) and hash_freeze() give back
+ * the same keys, for a full hash and an empty one.
+ */
+private void
+frozen_test(void)
+{
+	hash	*h, *f;
+	int	i, n, kl, vl;
+	char	key[64], val[64];
+
+	for (n = 0; n <= NKEYS; n += NKEYS) {
+		h = hash_new(HASH_MEMHASH);
+		for (i = 0; i < n; i++) {
+			kl = mkkey(0, i, key);
+			vl = mkval(0, i, i % 3, val);
+			hash_insert(h, key, kl, val, vl);
+		}
+		assert(!hash_toFrozen(h, "hash_test.tmp"));
+		f = hash_open(HASH_MMAP, "hash_test.tmp", O_RDONLY, 0);
+		assert(f);
+		sameHash(f, h);
+		sameHash(h, f);
+		kl = mkkey(0, n, key);
+		assert(!hash_fetch(f, key, kl));
+		hash_close(f);
+		unlink("hash_test.tmp");
+
+		assert((f = hash_freeze(h)));
+		sameHash(f, h);
+		sameHash(h, f);
+		assert(!hash_fetch(f, key, kl));
+		hash_free(f);
+		hash_free(h);
+	}
+}
+
+/*
+ * A hamt snapshot keeps what the hash held when it was taken, even
+ * after the hash is changed and freed.
+ */
+private void
+snapshot_test(void)
+{
+	hash	*h, *s, *ref;
+	int	i, kl, vl;
+	char	key[64], val[64], buf[64];
+
+	h = hash_new(HASH_HAMT);
+	ref = hash_new(HASH_MEMHASH);
+	for (i = 0; i < NKEYS; i++) {
+		kl = mkkey(0, i, key);
+		vl = mkval(0, i, 0, val);
+		hash_insert(h, key, kl, val, vl);
+		hash_insert(ref, key, kl, val, vl);
+	}
+	assert((s = hash_snapshot(h)));
+	for (i = 0; i < NKEYS; i += 3) {
+		kl = mkkey(0, i, key);
+		vl = mkval(0, i, 1, val);
+		hash_store(h, key, kl, val, vl);
+	}
+	for (i = 0; i < NKEYS; i += 5) {
+		kl = mkkey(0, i, key);
+		hash_delete(h, key, kl);
+	}
+	for (i = NKEYS; i < NKEYS + 100; i++) {
+		kl = mkkey(0, i, key);
+		vl = mkval(0, i, 0, val);
+		hash_insert(h, key, kl, val, vl);
+	}
+	assert(hash_count(h) == NKEYS - NKEYS / 5 + 100);
+	sameHash(s, ref);
+	sameHash(ref, s);
+	hash_free(h);
+	for (i = 0; i < NKEYS; i += 3) {
+		kl = mkkey(0, i, key);
+		vl = mkval(0, i, 0, val);
+		assert(hash_fetchCopy(s, key, kl, buf, sizeof(buf)) == vl);
+		assert(!memcmp(buf, val, vl));
+	}
+	hash_free(s);
+	assert(!hash_snapshot(ref) && (errno == ENOTSUP));
+	hash_free(ref);
+}
+
+/*
+ * Check a btree walks in key order both ways, including after
+ * deletes, and that hash_seek() finds the first key >= its key.
+ */
+private void
+btree_test(void)
+{
+	hash	*h, *h2;
+	char	**keys = 0;
+	int	i, j, kl;
+	char	key[64];
+	char	*probe[] = {
+		"", "a/", "a/longer/dir/key4999", "c", "d/key1", "d/key10\001",
+		"zzz", 0
+	};
+
+	h = hash_new(HASH_BTREE);
+	for (i = 0; i < NKEYS; i++) {
+		j = (i * 7919) % NKEYS;		/* not in order */
+		kl = mkkey(0, j, key);
+		hash_insert(h, key, kl, &j, sizeof(j));
+		keys = addLine(keys, strdup(key));
+	}
+	sortLines(keys, 0);
+	i = 0;
+	EACH_HASH(h) assert(streq(h->kptr, keys[++i]));
+	assert(i == nLines(keys));
+	for (hash_last(h); h->kptr; hash_prev(h)) {
+		assert(streq(h->kptr, keys[i--]));
+	}
+	assert(i == 0);
+
+	for (j = 0; probe[j]; j++) {
+		EACH(keys) if (strcmp(keys[i], probe[j]) >= 0) break;
+		for (kl = strlen(probe[j]); kl <= strlen(probe[j]) + 1; kl++) {
+			if (i > nLines(keys)) {
+				assert(!hash_seek(h, probe[j], kl));
+				continue;
+			}
+			assert(hash_seek(h, probe[j], kl));
+			assert(streq(h->kptr, keys[i]));
+			hash_next(h);
+			if (i < nLines(keys)) {
+				assert(streq(h->kptr, keys[i+1]));
+			} else {
+				assert(!h->kptr);
+			}
+			hash_seek(h, probe[j], kl);
+			hash_prev(h);
+			if (i > 1) {
+				assert(streq(h->kptr, keys[i-1]));
+			} else {
+				assert(!h->kptr);
+			}
+		}
+	}
+
+	/* delete every other key and walk again */
+	EACH(keys) {
+		if (i & 1) assert(!hash_deleteStr(h, keys[i]));
+	}
+	i = 0;
+	EACH_HASH(h) assert(streq(h->kptr, keys[i += 2]));
+	assert(i == nLines(keys));
+	for (hash_last(h); h->kptr; hash_prev(h)) {
+		assert(streq(h->kptr, keys[i]));
+		i -= 2;
+	}
+	assert(i == 0);
+	freeLines(keys, free);
+
+	h2 = hash_new(HASH_MEMHASH);
+	assert(!hash_seek(h2, "a", 1) && (errno == ENOTSUP));
+	hash_free(h2);
+	hash_free(h);
+}
+
+/*
+ * Check every backend and the APIs that go with them against memhash.
+ * Exits on the first failure.
+ */
+private void
+hash_tests(void)
+{
+	backend_test(HASH_MEMHASH, 0, 0);
+	backend_test(HASH_MEMHASH|HASH_ARENA, 0, 0);
+	backend_test(HASH_MEMHASH|HASH_INCREMENTAL, 0, 0);
+	backend_test(HASH_MEMHASH|HASH_FN_CRC32C, 0, 0);
+	backend_test(HASH_U32HASH, sizeof(u32), sizeof(u32));
+	backend_test(HASH_U32HASH|HASH_INCREMENTAL, sizeof(u32), sizeof(u64));
+	backend_test(HASH_SIMDHASH, 0, 0);
+	backend_test(HASH_U64HASH, sizeof(u64), sizeof(u64));
+	backend_test(HASH_CONCURRENT, 0, 0);
+	backend_test(HASH_CONCURRENT|HASH_SHARDS(4)|HASH_ARENA, 0, 0);
+	backend_test(HASH_BTREE, 0, 0);
+	backend_test(HASH_STRHASH, 0, 0);
+	backend_test(HASH_HAMT, 0, 0);
+	stream_test();
+	frozen_test();
+	snapshot_test();
+	btree_test();
+}
+
 int
 main(int ac, char **av)
 {
@@ -16,18 +377,21 @@ main(int ac, char **av)
 	int	hex = 0;
 	FILE	*f;
 
-	while ((c = getopt(ac, av, "nrwX")) != -1) {
+	while ((c = getopt(ac, av, "nrstwX")) != -1) {
 		switch (c) {
 		    case 'n': mode = c; break;
 		    case 'r': mode = c; break;
+		    case 's': mode = c; break;
+		    case 't': mode = c; break;
 		    case 'w': mode = c; break;
 		    case 'X': hex = 1; break;
 		    default: goto usage;
 		}
 	}
 	file = av[optind];
-	unless (file && mode) {
-usage:		fprintf(stderr, "usage: bk _hashfile_test [-nrwX] file\n");
+	unless (mode && (file || (mode == 't'))) {
+usage:		fprintf(stderr, "usage: bk _hashfile_test [-nrswX] file\n");
+		fprintf(stderr, "       bk _hashfile_test -t\n");
 		return (1);
 	}
 	switch (mode) {
@@ -56,6 +420,22 @@ next:			unless (feof(f)) printf("---\n");
 		}
 		fclose(f);
 		break;
+	    case 's':
+		// read all hashes from av[2], dump hash_stats() for each
+		unless (f = fopen(file, "r")) return (1);
+		while (!feof(f)) {
+			unless (h = hash_fromStream(0, f)) continue;
+			hash_printStats(h, stdout);
+			hash_free(h); h = 0;
+			unless (feof(f)) printf("---\n");
+		}
+		fclose(f);
+		break;
+	    case 't':
+		// run the self tests, asserts on failure
+		hash_tests();
+		printf("ok\n");
+		break;
 	    case 'w':
 		// read hash from av[2], write back out to stdout
 		h = hash_fromFile(0, file);
@@ -17,6 +17,7 @@
 #include "hash.h"
 
 #include <ctype.h>
+#include <limits.h>
 
 #include "style.h"
 #include "lines/lines.h"
@@ -26,11 +27,31 @@
 /*
  * Routines to save and restore a hash to and from a file. The format
  * used in the file is the same as in the bugdb.
+ *
+ * There is also a binary format written by hash_toBinStream() for
+ * big hashes.  It starts with a null byte, which can't start the text
+ * format, and hash_fromStream() reads either one.
+ *
+ *   magic	"\0BKHASH1"
+ *   flags	u32, HASH_BIN_SORTED if the keys are in sorted order
+ *   count	u32, number of records
+ *   records	u32 klen, u32 vlen, key, value
+ *
+ * The numbers are in native byte order.
  */
 
+#define	BINMAGIC	"\0BKHASH1"
+#define	BINMAGICLEN	8
+
+typedef struct {
+	u32	klen;
+	u32	vlen;
+} binrec;
+
 private	int binaryField(u8 *data, int len);
 private	int goodkey(u8 *key, int len);
 private	void writeField(FILE *f, char *key, u8 *data, int len);
+private	hash *binStream(hash *h, FILE *f);
 
 
 /*
@@ -74,6 +95,22 @@ hash_toStream(hash *h, FILE *f)
 		fputc('\n', f);
 	}
 
+	/*
+	 * An ordered hash already walks the keys in strcmp() order so
+	 * they can be written as we go.
+	 */
+	if (h->ops->seek) {
+		EACH_HASH(h) {
+			if ((h->klen == 1) && (*(u8*)h->kptr == 0)) continue;
+			unless (goodkey(h->kptr, h->klen)) return (-1);
+		}
+		EACH_HASH(h) {
+			if ((h->klen == 1) && (*(u8*)h->kptr == 0)) continue;
+			writeField(f, h->kptr, h->vptr, h->vlen);
+		}
+		return (0);
+	}
+
 	/*
 	 * Sort the fields and print them
 	 */
@@ -94,7 +131,105 @@ out:	freeLines(fieldlist, 0);
 }
 
 /*
- * Read a file written by the function above and add keys to 'h'
+ * write the hash to a file named by path in the binary format
+ * returns -1 on error, or 0
+ */
+int
+hash_toBinFile(hash *h, char *path, int flags)
+{
+	FILE	*f;
+	int	rc = -1;
+
+	if ((f = fopen(path, "w"))) {
+		rc = hash_toBinStream(h, f, flags);
+		if (fclose(f)) rc = -1;
+	}
+	return (rc);
+}
+
+typedef struct {
+	u64	pfx;		/* first 8 bytes of key, big-endian */
+	void	*kptr;
+	void	*vptr;
+	int	klen;
+	int	vlen;
+} kv;
+
+private int
+kv_sort(const void *a, const void *b)
+{
+	const	kv *l = a, *r = b;
+	int	c;
+
+	/* most keys differ in the first 8 bytes */
+	if (l->pfx != r->pfx) return ((l->pfx < r->pfx) ? -1 : 1);
+	if ((c = memcmp(l->kptr, r->kptr, min(l->klen, r->klen)))) return (c);
+	return (l->klen - r->klen);
+}
+
+/*
+ * Write the hash to a FILE* in the binary format.  Each record is
+ * written straight from the hash while walking it.
+ *
+ * With HASH_BIN_SORTED the records are written in memcmp() order of
+ * the keys, like hash_toStream() does.  That is free for an ordered
+ * hash, other hashes sort an array of pointers to the keys first.
+ *
+ * returns -1 on error, or 0
+ */
+int
+hash_toBinStream(hash *h, FILE *f, int flags)
+{
+	kv	*list = 0;
+	binrec	r;
+	u32	hdr[2];
+	int	i, n;
+
+	assert(h && f);
+	n = hash_count(h);
+	if ((flags & HASH_BIN_SORTED) && !h->ops->seek) {
+		list = malloc(n * sizeof(kv));
+		i = 0;
+		EACH_HASH(h) {
+			list[i].pfx = 0;
+			memcpy(&list[i].pfx, h->kptr, min(h->klen, 8));
+			list[i].pfx = __builtin_bswap64(list[i].pfx);
+			list[i].kptr = h->kptr;
+			list[i].klen = h->klen;
+			list[i].vptr = h->vptr;
+			list[i].vlen = h->vlen;
+			i++;
+		}
+		assert(i == n);
+		qsort(list, n, sizeof(kv), kv_sort);
+	}
+	fwrite(BINMAGIC, 1, BINMAGICLEN, f);
+	hdr[0] = flags & HASH_BIN_SORTED;
+	hdr[1] = n;
+	fwrite(hdr, sizeof(hdr), 1, f);
+	if (list) {
+		for (i = 0; i < n; i++) {
+			r.klen = list[i].klen;
+			r.vlen = list[i].vlen;
+			fwrite(&r, sizeof(r), 1, f);
+			fwrite(list[i].kptr, 1, r.klen, f);
+			fwrite(list[i].vptr, 1, r.vlen, f);
+		}
+		free(list);
+	} else {
+		EACH_HASH(h) {
+			r.klen = h->klen;
+			r.vlen = h->vlen;
+			fwrite(&r, sizeof(r), 1, f);
+			fwrite(h->kptr, 1, r.klen, f);
+			fwrite(h->vptr, 1, r.vlen, f);
+		}
+	}
+	return (ferror(f) ? -1 : 0);
+}
+
+/*
+ * Read a file written by the functions above and add keys to 'h'
  * overwriting any existing keys.
  * If h==0 and path doesn't exist or is empty, then 0 is returned.
  */
@@ -111,10 +246,11 @@ hash_fromFile(hash *h, char *path)
 }
 
 /*
- * Read a stream written by the function above and add keys to 'h'
- * overwriting any existing keys.
+ * Read a stream written by hash_toStream() or hash_toBinStream() and
+ * add keys to 'h' overwriting any existing keys.
  * The function returns at EOF or when a line with just "@\n" is
  * encountered.  (record separator to put multiple KV's in a file)
+ * A binary stream ends after the number of records in its header.
  * If h==0, then a new hash is created if any data is found.
  */
 hash *
@@ -123,8 +259,10 @@ hash_fromStream(hash *h, FILE *f)
 	hashpl	state = {0};
 	char	*buf = 0;
 	size_t	bufsz = 0;
-	int	len;
+	int	len, c;
 	assert(f);
+	if ((c = getc(f)) == 0) return (binStream(h, f));
+	if (c != EOF) ungetc(c, f);
 	while (getline(&buf, &bufsz, f) > 0) {
 		len = strlen(buf);
 		if (len > 0 && buf[len-1] == '\n')
@@ -137,6 +275,61 @@ hash_fromStream(hash *h, FILE *f)
 	return (h);
 }
 
+/*
+ * Read the rest of a binary stream after the first byte of the magic.
+ */
+private hash *
+binStream(hash *h, FILE *f)
+{
+	char	magic[BINMAGICLEN];
+	binrec	r;
+	struct	stat st;
+	u32	hdr[2];
+	u32	i, n;
+	u64	len;
+	char	*buf = 0, *t;
+	size_t	bufsz = 0;
+	long	off;
+
+	if ((fread(magic + 1, 1, BINMAGICLEN - 1, f) != BINMAGICLEN - 1) ||
+	    memcmp(magic + 1, BINMAGIC + 1, BINMAGICLEN - 1) ||
+	    (fread(hdr, sizeof(hdr), 1, f) != 1)) {
+		fprintf(stderr, "hash_fromStream: bad binary header\n");
+		return (h);
+	}
+	/*
+	 * Only presize for as many records as a file has room for, a bad
+	 * count shouldn't turn into a huge allocation.
+	 */
+	n = 0;
+	if (!fstat(fileno(f), &st) && S_ISREG(st.st_mode) &&
+	    ((off = ftell(f)) >= 0) && (st.st_size > off)) {
+		n = min(hdr[1], (st.st_size - off) / sizeof(binrec));
+	}
+	if (h) {
+		if (n) hash_reserve(h, hash_count(h) + n);
+	} else {
+		h = hash_newSized(HASH_MEMHASH, n);
+	}
+	for (i = 0; i < hdr[1]; i++) {
+		if (fread(&r, sizeof(r), 1, f) != 1) break;
+		if ((r.klen > INT_MAX) || (r.vlen > INT_MAX)) break;
+		len = (u64)r.klen + r.vlen;
+		if (len > bufsz) {
+			unless (t = realloc(buf, max(len, 2 * bufsz))) break;
+			buf = t;
+			bufsz = max(len, 2 * bufsz);
+		}
+		if (fread(buf, 1, len, f) != len) break;
+		hash_store(h, buf, r.klen, buf + r.klen, r.vlen);
+	}
+	if (i < hdr[1]) {
+		fprintf(stderr, "hash_fromStream: short read or bad record\n");
+	}
+	free(buf);
+	return (h);
+}
+
 /*
  * Read a line of data from a DB file and write it to the hash
  * Data gets buffered up locally to so a key is only written after
@@ -20,6 +20,7 @@
 
 #include "utils/webencode.h"
 #include "lines/lines.h"
+#include "lines/data.h"
 
 /*
  * Routines to save and restore a hash to and from a string.  To be
@@ -27,54 +28,97 @@
  * query strings.
  */
 
+/*
+ * Append 'h' to 'd' as a query string, with the pairs sorted.  The
+ * pairs are all encoded into one buffer, sorted by pointer and then
+ * copied once into 'd', so reusing 'd' for the next hash costs no
+ * allocations at all once it is big enough.
+ */
+void
+hash_toStrData(hash *h, DATA *d)
+{
+	DATA	enc = {0};
+	char	**pairs;
+	u32	*offs;
+	int	i, n, len;
+
+	unless (n = hash_count(h)) return;
+	offs = malloc(n * sizeof(u32));
+	i = 0;
+	EACH_HASH(h) {
+		offs[i++] = enc.len;
+		webencodeData(&enc, h->kptr, h->klen);
+		data_append(&enc, "=", 1);
+		webencodeData(&enc, h->vptr, h->vlen);
+		enc.len++;		/* keep the null between pairs */
+	}
+	assert(i == n);
+
+	/* enc.buf doesn't move now, so sort pointers into it */
+	pairs = malloc(n * sizeof(char *));
+	for (i = 0; i < n; i++) pairs[i] = enc.buf + offs[i];
+	free(offs);
+	qsort(pairs, n, sizeof(char *), string_sort);	/* sort by keys */
+
+	data_resize(d, d->len + enc.len + 1);
+	for (i = 0; i < n; i++) {
+		if (i) d->buf[d->len++] = '&';
+		len = strlen(pairs[i]);
+		memcpy(d->buf + d->len, pairs[i], len);
+		d->len += len;
+	}
+	d->buf[d->len] = 0;
+	free(pairs);
+	free(enc.buf);
+}
+
 char *
 hash_toStr(hash *h)
 {
-	char	**data = 0;
-	char	*ret;
-	char	*buf = 0;
-	FILE	*f = fmemopen(&buf, 256, "w+");
+	DATA	d = {0};
 
-	EACH_HASH(h) {
-		webencode(f, h->kptr, h->klen);
-		putc('=', f);
-		webencode(f, h->vptr, h->vlen);
-		fflush(f);
-		data = addLine(data, strdup(buf));
-		fseek(f, 0L, SEEK_SET);
-	}
-	fclose(f);
-	sortLines(data, 0);	/* sort by keys */
-	ret = joinLines("&", data);
-	freeLines(data, free);
-	return (ret);
+	hash_toStrData(h, &d);
+	return (d.buf);
 }
 
+/*
+ * The keys and values are decoded into one scratch buffer, the
+ * size of 'str', and stored straight from there, so there is one
+ * allocation per call rather than two per pair.
+ */
 int
 hash_fromStr(hash *h, char *str)
 {
 	char	*p = str;
-	char	*k = 0, *v = 0;
-	int	klen, vlen;
-
+	char	*k, *v, *buf;
+	int	klen, vlen, n;
+
+	/* one '&' between each pair */
+	n = (*p != 0);
+	while ((p = strchr(p, '&'))) n++, p++;
+	unless (n) return (0);
+	hash_reserve(h, hash_count(h) + n);
+
+	/* every decoded pair fits in what it was decoded from, +2 nulls */
+	buf = malloc(strlen(str) + 2);
+	p = str;
 	while (*p) {
-		unless (p = webdecode(p, &k, &klen)) {
+		k = buf;
+		unless (p = webdecodeBuf(p, k, &klen)) {
 err:			fprintf(stderr,
 			    "ERROR: hash_fromStr() can't parse '%s'\n",
 			    str);
-			if (k) free(k);
-			if (v) free(v);
+			free(buf);
 			return (-1);
 		}
 		unless (*p++ == '=') goto err;
-		unless (p = webdecode(p, &v, &vlen)) goto err;
+		v = k + klen;
+		unless (p = webdecodeBuf(p, v, &vlen)) goto err;
 		hash_store(h, k, klen, v, vlen);
-		if (k) free(k);
-		if (v) free(v);
-		k = v = 0;
 		unless (*p) break;
 		unless (*p++ == '&') goto err;
 	}
+	free(buf);
 	return (0);
 }
 
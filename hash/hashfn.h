@@ -0,0 +1,109 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The key hash functions picked with the HASH_FN_* options to
+ * hash_new().  These are inline so the integer mixes compile down to
+ * a few instructions in the backends' lookup loops.
+ */
+
+#ifndef	_HASHFN_H_
+#define	_HASHFN_H_
+
+#include "utils/crc32c.h"
+
+/* murmur3 finalizer: every input bit affects every output bit */
+private inline u32
+hashfn_u32(u32 x)
+{
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35;
+	x ^= x >> 16;
+	return (x);
+}
+
+private inline u32
+hashfn_u64(u64 x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return (x);
+}
+
+/* 64x64->128 multiply, folded */
+private inline u64
+hashfn_mum(u64 a, u64 b)
+{
+	__uint128_t	r = (__uint128_t)a * b;
+
+	return ((u64)r ^ (u64)(r >> 64));
+}
+
+/*
+ * A wyhash style hash: 8 bytes at a time through a 128-bit multiply.
+ * Much faster than crc32c() for short keys since there is no call
+ * or dispatch, but crc32c() wins on long keys when the hardware
+ * instruction is available.
+ */
+private inline u32
+hashfn_wy(void *buf, int len)
+{
+	u8	*p = buf;
+	u64	w, h = 0x9e3779b97f4a7c15ULL ^ (u64)len;
+
+	while (len > 8) {
+		memcpy(&w, p, 8);
+		h = hashfn_mum(h ^ w, 0xa0761d6478bd642fULL);
+		p += 8;
+		len -= 8;
+	}
+	w = 0;
+	memcpy(&w, p, len);
+	h = hashfn_mum(h ^ w, 0xe7037ed1a0b428dbULL);
+	return ((u32)(h ^ (h >> 32)));
+}
+
+/* keys this long or shorter use hashfn_wy() by default */
+#define	HASHFN_SHORT	16
+
+/*
+ * Hash a key with the function selected by 'fn', one of the
+ * HASH_FN_* options.  HASH_FN_DEFAULT picks by key length.
+ */
+private inline u32
+hashfn(int fn, void *buf, int len)
+{
+	switch (fn) {
+	    case HASH_FN_CRC32C:
+		return (crc32c(0, buf, len));
+	    case HASH_FN_WY:
+		return (hashfn_wy(buf, len));
+	    case HASH_FN_INT:
+		if (len == sizeof(u32)) return (hashfn_u32(*(u32 *)buf));
+		if (len == sizeof(u64)) return (hashfn_u64(*(u64 *)buf));
+		return (hashfn_wy(buf, len));
+	    default:
+		if (len <= HASHFN_SHORT) return (hashfn_wy(buf, len));
+		return (crc32c(0, buf, len));
+	}
+}
+
+#endif
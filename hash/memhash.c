@@ -16,7 +16,11 @@
 
 #include "hash.h"
 #include "memhash.h"
-#include "utils/crc32c.h"
+#include "hashfn.h"
+#include "lines/arena.h"
+
+#include <pthread.h>
+#include <unistd.h>
 
 typedef struct node node;
 typedef	struct memhash memhash;
@@ -25,6 +29,14 @@ struct memhash {
 	int	nodes;		/* number of elements in hash */
 	node	**arr;		/* array indexed by hash */
 	u32	mask;		/* size of array */
+	ARENA	*arena;		/* HASH_ARENA: nodes allocated from here */
+	int	fn;		/* HASH_FN_* for keys */
+
+	/* HASH_INCREMENTAL: the table being moved to arr */
+	node	**oldarr;	/* old array, 0 if not resizing */
+	u32	oldmask;	/* size of old array */
+	u32	migrate;	/* buckets below this have been moved */
+	u8	incremental;	/* resize a few buckets at a time */
 
 	/* for nextkey .. */
 	int	lastidx;
@@ -34,14 +46,25 @@ struct memhash {
 
 struct node {
 	node	*next;		/* next element in same hash bucket */
+	u32	hash;		/* HASH() of key, saved for splits */
 	u32	klen;		/* key len */
 	u32	dlen;		/* data len */
-	char	key[0];		/* key and data stored here */
+	char	key[0] __attribute__((aligned(8))); /* key and data here */
 };
 
 node	*nodes;
 
-#define	HASH(buf, len) crc32c(0, buf, len)
+#define	HASH(h, buf, len) hashfn((h)->fn, buf, len)
+
+/* HASH_INCREMENTAL: number of old buckets moved per operation */
+#define	MIGRATE_STEP	8
+
+/* number of keys in flight in fetchBatch/storeBatch */
+#define	BATCH		16
+
+/* set operations on hashes with more keys than this use threads */
+#define	SETOP_PARALLEL	(1 << 18)
+#define	SETOP_THREADS	8
 
 /*
  * Find the offset of the data in the key array given the klen and
@@ -66,13 +89,20 @@ DOFF(int klen, int dlen)
 	return ((klen + mask) & ~mask);
 }
 
-private	void	memhash_split(memhash *h);
+private	void	memhash_split(memhash *h, int newmask);
+private	void	migrate(memhash *h, u32 cnt);
 
 /*
  * Create a new hash structure.
+ *
+ * With HASH_ARENA the nodes are carved out of large chunks instead
+ * of being malloc'ed one at a time, and freeing the hash just frees
+ * the chunks.  The space for deleted or replaced nodes is not reused
+ * until the hash is freed, so this is meant for hashes that are
+ * built, used and thrown away.
  */
 hash *
-memhash_new(va_list ap)
+memhash_new(int flags, va_list ap)
 {
 	memhash	*ret;
 
@@ -80,6 +110,9 @@ memhash_new(va_list ap)
 	ret->nodes = 0;
 	ret->mask = 63;
 	ret->arr = calloc(ret->mask + 1, sizeof(*ret->arr));
+	if (flags & HASH_ARENA) ret->arena = new(ARENA);
+	if (flags & HASH_INCREMENTAL) ret->incremental = 1;
+	ret->fn = flags & HASH_FNMASK;
 	return ((hash *)ret);
 }
 
@@ -93,6 +126,13 @@ memhash_free(hash *_h)
 	int	i;
 	node	*n, *t;
 
+	if (h->oldarr) migrate(h, h->oldmask + 1);
+	if (h->arena) {
+		arena_free(h->arena);
+		free(h->arena);
+		free(h->arr);
+		return (0);
+	}
 	for (i = 0; i <= h->mask; i++) {
 		n = h->arr[i];
 		while (n) {
@@ -105,23 +145,55 @@ memhash_free(hash *_h)
 	return (0);
 }
 
+/*
+ * Return the bucket for a hash.
+ *
+ * While an incremental resize is running, keys whose old bucket has
+ * not been moved yet are still found (and added) in the old array.
+ */
+private inline node **
+bucket(memhash *h, u32 hash)
+{
+	if (h->oldarr && ((hash & h->oldmask) >= h->migrate)) {
+		return (&h->oldarr[hash & h->oldmask]);
+	} else {
+		return (&h->arr[hash & h->mask]);
+	}
+}
+
 /*
  * Find a node in the hash and return a pointer to the pointer that
  * points at that node.  Or return a pointer to where the node should
  * be added to the hash.
+ *
+ * Nodes with a different hash are skipped without looking at their
+ * keys.  This doesn't write to 'h' so several threads can search
+ * at once.
  */
 private inline node **
-find_nodep(memhash *h, void *kptr, int klen)
+chain_find(memhash *h, u32 hash, void *kptr, int klen)
 {
-	u32	hash = HASH(kptr, klen);
 	node	*n, **nn;
 
-	nn = &h->arr[hash & h->mask];
+	nn = bucket(h, hash);
 	while ((n = *nn) &&
-	    !(klen == n->klen && !memcmp(n->key, kptr, klen))) {
+	    !((hash == n->hash) && (klen == n->klen) &&
+		!memcmp(n->key, kptr, klen))) {
 		nn = &(n->next);
 	}
-	if (n) {
+	return (nn);
+}
+
+/*
+ * chain_find() and set the kptr/vptr if found
+ */
+private inline node **
+find_nodep_hash(memhash *h, u32 hash, void *kptr, int klen)
+{
+	node	*n, **nn;
+
+	nn = chain_find(h, hash, kptr, klen);
+	if ((n = *nn)) {
 		h->hdr.kptr = n->key;
 		h->hdr.klen = klen;
 		h->hdr.vptr = n->key + DOFF(klen, n->dlen);
@@ -130,6 +202,17 @@ find_nodep(memhash *h, void *kptr, int klen)
 	return (nn);
 }
 
+/*
+ * Like find_nodep_hash() but hashes the key and returns the hash
+ * in *hashp.
+ */
+private inline node **
+find_nodep(memhash *h, void *kptr, int klen, u32 *hashp)
+{
+	*hashp = HASH(h, kptr, klen);
+	return (find_nodep_hash(h, *hashp, kptr, klen));
+}
+
 /*
  * find key in hash and return a pointer to the data.
  * Returns NULL if not found.
@@ -140,8 +223,10 @@ memhash_fetch(hash *_h, void *kptr, int klen)
 {
 	memhash	*h = (memhash *)_h;
 	node	*n, **nn;
+	u32	hash;
 
-	nn = find_nodep(h, kptr, klen);
+	if (h->oldarr) migrate(h, MIGRATE_STEP);
+	nn = find_nodep(h, kptr, klen, &hash);
 	unless (n = *nn) {
 		h->hdr.kptr = h->hdr.vptr = 0;
 		h->hdr.klen = h->hdr.vlen = 0;
@@ -154,20 +239,25 @@ memhash_fetch(hash *_h, void *kptr, int klen)
  * Allocate a new code and add it to the chain at nn
  */
 private inline void *
-new_node(memhash *h, node **nn, void *kptr, int klen, int dlen)
+new_node(memhash *h, node **nn, u32 hash, void *kptr, int klen, int dlen)
 {
 	node	*n;
 	int	doff;
 
 	doff = DOFF(klen, dlen);
-	n = malloc(sizeof(node) + doff + dlen);
+	if (h->arena) {
+		n = arena_alloc(h->arena, sizeof(node) + doff + dlen);
+	} else {
+		n = malloc(sizeof(node) + doff + dlen);
+	}
+	n->hash = hash;
 	h->hdr.kptr = memcpy(n->key, kptr, klen);
 	h->hdr.klen = n->klen = klen;
 	h->hdr.vptr = n->key + doff;
 	h->hdr.vlen = n->dlen = dlen;
 	n->next = *nn;
 	*nn = n;
-	if (++h->nodes >= h->mask) memhash_split(h);
+	if (++h->nodes >= h->mask) memhash_split(h, ((h->mask + 1) << 1) - 1);
 	return (h->hdr.vptr);
 }
 
@@ -183,14 +273,16 @@ memhash_insert(hash *_h, void *kptr, int klen, void *dptr, int dlen)
 	memhash	*h = (memhash *)_h;
 	node	**nn;
 	void	*ret;
+	u32	hash;
 
-	nn = find_nodep(h, kptr, klen);
+	if (h->oldarr) migrate(h, MIGRATE_STEP);
+	nn = find_nodep(h, kptr, klen, &hash);
 	if (*nn) {
 		/* ret 0, but h->kptr points at existing data */
 		errno = EEXIST;
 		return (0);
 	}
-	ret = new_node(h, nn, kptr, klen, dlen);
+	ret = new_node(h, nn, hash, kptr, klen, dlen);
 	if (dlen) {
 		if (dptr) {
 			memcpy(ret, dptr, dlen);
@@ -202,14 +294,17 @@ memhash_insert(hash *_h, void *kptr, int klen, void *dptr, int dlen)
 }
 
 
-void *
-memhash_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+/*
+ * store (key, data) given the hash of the key
+ */
+private void *
+store_hash(memhash *h, u32 hash, void *kptr, int klen, void *dptr, int dlen)
 {
-	memhash	*h = (memhash *)_h;
 	node	*n, **nn, *nfree = 0;
 	void	*ret = 0;
 
-	nn = find_nodep(h, kptr, klen);
+	if (h->oldarr) migrate(h, MIGRATE_STEP);
+	nn = find_nodep_hash(h, hash, kptr, klen);
 	if ((n = *nn) != 0) {
 		if (dlen > n->dlen) {
 			*nn = n->next;
@@ -220,7 +315,7 @@ memhash_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
 			ret = &n->key[DOFF(klen, dlen)];
 		}
 	}
-	unless (ret) ret = new_node(h, nn, kptr, klen, dlen);
+	unless (ret) ret = new_node(h, nn, hash, kptr, klen, dlen);
 	if (dlen) {
 		if (dptr) {
 			memcpy(ret, dptr, dlen);
@@ -228,10 +323,85 @@ memhash_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
 			memset(ret, 0, dlen);
 		}
 	}
-	if (nfree) free(nfree);
+	if (nfree && !h->arena) free(nfree);
 	return (ret);
 }
 
+void *
+memhash_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	memhash	*h = (memhash *)_h;
+
+	return (store_hash(h, HASH(h, kptr, klen), kptr, klen, dptr, dlen));
+}
+
+/*
+ * Fetch n keys at once.
+ *
+ * Keys are handled BATCH at a time.  All keys in a batch are hashed
+ * and their buckets prefetched, then the first node of each chain is
+ * prefetched, and only then are the chains walked.  On tables bigger
+ * than the cache this overlaps the misses for the whole batch instead
+ * of taking them one after another.
+ */
+int
+memhash_fetchBatch(hash *_h, void **keys, int *klens, int n, void **out)
+{
+	memhash	*h = (memhash *)_h;
+	u32	hashes[BATCH];
+	node	**nn[BATCH];
+	int	i, j, cnt, found = 0;
+
+	for (i = 0; i < n; i += BATCH) {
+		cnt = min(BATCH, n - i);
+		if (h->oldarr) migrate(h, MIGRATE_STEP);
+		for (j = 0; j < cnt; j++) {
+			hashes[j] = HASH(h, keys[i+j], klens[i+j]);
+			nn[j] = bucket(h, hashes[j]);
+			__builtin_prefetch(nn[j]);
+		}
+		for (j = 0; j < cnt; j++) {
+			if (*nn[j]) __builtin_prefetch(*nn[j]);
+		}
+		for (j = 0; j < cnt; j++) {
+			if (*find_nodep_hash(h, hashes[j], keys[i+j], klens[i+j])) {
+				out[i+j] = h->hdr.vptr;
+				++found;
+			} else {
+				out[i+j] = 0;
+			}
+		}
+	}
+	return (found);
+}
+
+/*
+ * Store n keys at once, prefetching like memhash_fetchBatch()
+ */
+int
+memhash_storeBatch(hash *_h, void **keys, int *klens,
+    void **vals, int *vlens, int n, void **out)
+{
+	memhash	*h = (memhash *)_h;
+	u32	hashes[BATCH];
+	int	i, j, cnt;
+	void	*ret;
+
+	for (i = 0; i < n; i += BATCH) {
+		cnt = min(BATCH, n - i);
+		for (j = 0; j < cnt; j++) {
+			hashes[j] = HASH(h, keys[i+j], klens[i+j]);
+			__builtin_prefetch(bucket(h, hashes[j]));
+		}
+		for (j = 0; j < cnt; j++) {
+			ret = store_hash(h, hashes[j], keys[i+j], klens[i+j],
+			    vals ? vals[i+j] : 0, vlens[i+j]);
+			if (out) out[i+j] = ret;
+		}
+	}
+	return (n);
+}
+
 /*
  * Delete hash entry.
  */
@@ -240,11 +410,12 @@ memhash_delete(hash *_h, void *kptr, int klen)
 {
 	memhash	*h = (memhash *)_h;
 	node	*n, **nn;
+	u32	hash;
 
-	nn = find_nodep(h, kptr, klen);
+	nn = find_nodep(h, kptr, klen, &hash);
 	if ((n = *nn) != 0) {
 		*nn = n->next;
-		free(n);
+		unless (h->arena) free(n);
 		assert(h->nodes > 0);
 		--h->nodes;
 		return (0);
@@ -259,6 +430,8 @@ memhash_first(hash *_h)
 {
 	memhash	*h = (memhash *)_h;
 
+	/* walking the hash only looks at the new array */
+	if (h->oldarr) migrate(h, h->oldmask + 1);
 	h->lastidx = -1;
 	h->lastnode = 0;
 	return (memhash_next(_h));
@@ -296,26 +469,209 @@ memhash_next(hash *_h)
 
 }
 
-/* double the size of a hash array because it has grown too large */
+/*
+ * One thread's share of a set operation: the nodes in buckets
+ * [lo, hi) of 'src' that are (want=1) or are not (want=0) in 'other'.
+ */
+typedef struct {
+	memhash	*src, *other;
+	u32	lo, hi;
+	int	want;
+	node	**out;
+	int	n, size;
+} setjob;
+
+private void *
+setscan(void *arg)
+{
+	setjob	*j = arg;
+	node	*t;
+	u32	i;
+	int	found;
+
+	for (i = j->lo; i < j->hi; i++) {
+		for (t = j->src->arr[i]; t; t = t->next) {
+			found = (*chain_find(j->other,
+			    t->hash, t->key, t->klen) != 0);
+			if (found != j->want) continue;
+			if (j->n == j->size) {
+				j->size = j->size ? 2 * j->size : 1024;
+				j->out = realloc(j->out, j->size * sizeof(node *));
+			}
+			j->out[j->n++] = t;
+		}
+	}
+	return (0);
+}
+
+/*
+ * Return the nodes of 'src' that are (want=1) or are not (want=0)
+ * in 'other' in *listp.  Big tables are split across threads by
+ * bucket range.
+ */
+private int
+setscan_all(memhash *src, memhash *other, int want, node ***listp)
+{
+	setjob	jobs[SETOP_THREADS];
+	pthread_t	tid[SETOP_THREADS];
+	node	**list;
+	u32	nb = src->mask + 1;
+	int	i, nj = 1, n = 0;
+
+	if (src->nodes >= SETOP_PARALLEL) {
+		nj = sysconf(_SC_NPROCESSORS_ONLN);
+		nj = max(1, min(nj, SETOP_THREADS));
+	}
+	memset(jobs, 0, sizeof(jobs));
+	for (i = 0; i < nj; i++) {
+		jobs[i].src = src;
+		jobs[i].other = other;
+		jobs[i].want = want;
+		jobs[i].lo = (u64)nb * i / nj;
+		jobs[i].hi = (u64)nb * (i + 1) / nj;
+	}
+	for (i = 1; i < nj; i++) {
+		if (pthread_create(&tid[i], 0, setscan, &jobs[i])) {
+			setscan(&jobs[i]);
+			tid[i] = 0;
+		}
+	}
+	setscan(&jobs[0]);
+	for (i = 1; i < nj; i++) if (tid[i]) pthread_join(tid[i], 0);
+
+	for (i = 0; i < nj; i++) n += jobs[i].n;
+	list = malloc((n ? n : 1) * sizeof(node *));
+	n = 0;
+	for (i = 0; i < nj; i++) {
+		unless (jobs[i].out) continue;
+		memcpy(list + n, jobs[i].out, jobs[i].n * sizeof(node *));
+		n += jobs[i].n;
+		free(jobs[i].out);
+	}
+	*listp = list;
+	return (n);
+}
+
+/* store node t from another memhash into C, reusing its hash if we can */
+private void
+setstore(hash *C, int samefn, node *t)
+{
+	if (samefn) {
+		store_hash((memhash *)C, t->hash,
+		    t->key, t->klen, t->key + DOFF(t->klen, t->dlen), t->dlen);
+	} else {
+		hash_store(C, t->key, t->klen,
+		    t->key + DOFF(t->klen, t->dlen), t->dlen);
+	}
+}
+
+/*
+ * Set operations for hash_keyDiff3() and friends when A and B are
+ * both memhashes with the same hash function.  The hash saved in each
+ * node of one table is used to search the other so no key is hashed
+ * twice, and the searching is done by several threads for big tables.
+ * C can be any hash but is fastest as a memhash like A.
+ *
+ * Returns the same as the hash_key*() function, or -1 if this can't
+ * be done here.
+ */
+int
+memhash_setop(int op, hash *_a, hash *_b, hash *C)
+{
+	memhash	*a = (memhash *)_a;
+	memhash	*b = (memhash *)_b;
+	node	**list, *t;
+	int	i, n, samefn;
+	u32	j;
+
+	unless ((_b->ops == _a->ops) && (b->fn == a->fn)) return (-1);
+	samefn = C && (C->ops == _a->ops) && (((memhash *)C)->fn == a->fn);
+
+	/* the threads only look at arr[] */
+	if (a->oldarr) migrate(a, a->oldmask + 1);
+	if (b->oldarr) migrate(b, b->oldmask + 1);
+	if (samefn && ((memhash *)C)->oldarr) {
+		migrate((memhash *)C, ((memhash *)C)->oldmask + 1);
+	}
+
+	switch (op) {
+	    case HASH_SETDIFF:		/* C = A - B */
+	    case HASH_SETINTERSECT:	/* C = A & B */
+		n = setscan_all(a, b, (op == HASH_SETINTERSECT), &list);
+		if (samefn) hash_reserve(C, hash_count(C) + n);
+		for (i = 0; i < n; i++) setstore(C, samefn, list[i]);
+		free(list);
+		return (n > 0);
+	    case HASH_SETUNION:		/* C = A | B */
+		n = setscan_all(b, a, 0, &list);
+		if (samefn) hash_reserve(C, hash_count(C) + a->nodes + n);
+		for (j = 0; j <= a->mask; j++) {
+			for (t = a->arr[j]; t; t = t->next) {
+				setstore(C, samefn, t);
+			}
+		}
+		for (i = 0; i < n; i++) setstore(C, samefn, list[i]);
+		free(list);
+		return (hash_count(C) > 0);
+	    case HASH_SETSUB:		/* A -= B */
+		n = setscan_all(b, a, 1, &list);
+		for (i = 0; i < n; i++) {
+			node	**nn;
+
+			t = list[i];
+			nn = chain_find(a, t->hash, t->key, t->klen);
+			t = *nn;
+			*nn = t->next;
+			unless (a->arena) free(t);
+			--a->nodes;
+		}
+		free(list);
+		return (a->nodes > 0);
+	    case HASH_SETMERGE:		/* A |= B */
+		n = setscan_all(b, a, 0, &list);
+		hash_reserve(_a, a->nodes + n);
+		for (i = 0; i < n; i++) setstore(_a, 1, list[i]);
+		free(list);
+		return (a->nodes > 0);
+	}
+	return (-1);
+}
+
+/*
+ * grow the hash array to newmask+1 buckets because it has grown too
+ * large (or memhash_reserve() was called)
+ *
+ * With HASH_INCREMENTAL this only allocates the new array and the
+ * nodes get moved over a few buckets at a time by migrate() on each
+ * following operation.  That finishes well before the next split.
+ */
 private void
-memhash_split(memhash *h)
+memhash_split(memhash *h, int newmask)
 {
-	int	newmask = ((h->mask + 1) << 1) - 1;
 	int	i;
 	node	*n;
 	node	*t;
 	node	**p;
 	node	**newarr;
-	u32	hash;
-
+	STATS_START(t0);
+
+	if (h->incremental) {
+		if (h->oldarr) migrate(h, h->oldmask + 1);
+		h->oldarr = h->arr;
+		h->oldmask = h->mask;
+		h->migrate = 0;
+		h->arr = calloc(newmask+1, sizeof(*h->arr));
+		h->mask = newmask;
+		STATS_END(&h->hdr, t0);
+		return;
+	}
 	newarr = calloc(newmask+1, sizeof(*newarr));
 	for (i = 0; i <= h->mask; i++) {
 		n = h->arr[i];
 		while (n) {
 			t = n;
 			n = n->next;
-			hash = HASH((u8 *)t->key, t->klen);
-			p = &newarr[hash & newmask];
+			p = &newarr[t->hash & newmask];
 			t->next = *p;
 			*p = t;
 		}
@@ -323,6 +679,47 @@ memhash_split(memhash *h)
 	free(h->arr);
 	h->arr = newarr;
 	h->mask = newmask;
+	STATS_END(&h->hdr, t0);
+}
+
+/*
+ * Grow the table so 'n' keys fit without more splits.
+ */
+int
+memhash_reserve(hash *_h, int n)
+{
+	memhash	*h = (memhash *)_h;
+	int	newmask = h->mask;
+
+	while (newmask <= n) newmask = ((newmask + 1) << 1) - 1;
+	if (newmask > h->mask) memhash_split(h, newmask);
+	return (0);
+}
+
+/*
+ * Move up to 'cnt' buckets from the old array to the new one and
+ * free the old array when it is empty.
+ */
+private void
+migrate(memhash *h, u32 cnt)
+{
+	node	*n, *t, **p;
+
+	while (cnt-- && (h->migrate <= h->oldmask)) {
+		n = h->oldarr[h->migrate];
+		h->oldarr[h->migrate++] = 0;
+		while (n) {
+			t = n;
+			n = n->next;
+			p = &h->arr[t->hash & h->mask];
+			t->next = *p;
+			*p = t;
+		}
+	}
+	if (h->migrate > h->oldmask) {
+		free(h->oldarr);
+		h->oldarr = 0;
+	}
 }
 
 int
@@ -332,3 +729,41 @@ memhash_count(hash *_h)
 
 	return (h->nodes);
 }
+
+/*
+ * Add up the chains in arr[] for memhash_stats().  The key n deep in
+ * a chain takes n probes to find.
+ */
+private void
+chainstats(node **arr, u32 mask, hashstats *s, u64 *sum)
+{
+	node	*n;
+	u32	i, len;
+
+	for (i = 0; i <= mask; i++) {
+		len = 0;
+		for (n = arr[i]; n; n = n->next) {
+			*sum += ++len;
+			s->bytes += sizeof(node) + DOFF(n->klen, n->dlen) + n->dlen;
+		}
+		if (len > s->maxprobe) s->maxprobe = len;
+	}
+}
+
+int
+memhash_stats(hash *_h, hashstats *s)
+{
+	memhash	*h = (memhash *)_h;
+	u64	sum = 0;
+
+	s->slots = h->mask + 1;
+	s->bytes = sizeof(memhash) + s->slots * sizeof(node *);
+	chainstats(h->arr, h->mask, s, &sum);
+	if (h->oldarr) {
+		/* HASH_INCREMENTAL: the keys that haven't moved yet */
+		chainstats(h->oldarr, h->oldmask, s, &sum);
+		s->bytes += (h->oldmask + 1) * sizeof(node *);
+	}
+	if (h->nodes) s->meanprobe = (double)sum / h->nodes;
+	return (0);
+}
@@ -14,15 +14,21 @@
  * limitations under the License.
  */
 
-hash	*memhash_new(va_list ap);
+hash	*memhash_new(int flags, va_list ap);
 int	memhash_free(hash *h);
 
 void	*memhash_fetch(hash *h, void *kptr, int klen);
 void	*memhash_insert(hash *h, void *kptr, int klen, void *val, int vlen);
 void	*memhash_store(hash *h, void *kptr, int klen, void *val, int vlen);
 int	memhash_delete(hash *h, void *kptr, int klen);
+int	memhash_fetchBatch(hash *h, void **keys, int *klens, int n, void **out);
+int	memhash_storeBatch(hash *h, void **keys, int *klens,
+	    void **vals, int *vlens, int n, void **out);
 
 void	*memhash_first(hash *h);
 void	*memhash_next(hash *h);
 
 int	memhash_count(hash *h);
+int	memhash_reserve(hash *h, int n);
+int	memhash_setop(int op, hash *A, hash *B, hash *C);
+int	memhash_stats(hash *h, hashstats *s);
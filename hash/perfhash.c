@@ -0,0 +1,383 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "perfhash.h"
+
+/*
+ * A read-only copy of another hash using a perfect hash function.
+ *
+ * Built with the CHD (compress, hash and displace) method: the keys
+ * are split into buckets of about LAMBDA keys each and, starting with
+ * the biggest bucket, each bucket gets the smallest displacement 'd'
+ * that puts all its keys in slots nobody has taken yet.  A lookup
+ * is then one hash of the key, one read of the bucket's displacement
+ * and exactly one slot to compare against.
+ *
+ * The displacements are u16s, about 3 bits per key, and the table is
+ * LOAD full so the last buckets still find a free slot quickly.  The
+ * slots are 16 bytes each and the keys and data are packed into one
+ * heap behind them.
+ */
+
+#define	LAMBDA	5		/* average keys per bucket */
+#define	LOAD	0.99		/* slots filled */
+#define	MAXD	0xffff		/* largest displacement */
+#define	TRIES	32		/* seeds to try before giving up */
+
+#define	EMPTY	0xffffffff	/* klen of empty slot */
+
+typedef struct {
+	u32	hash;		/* low bits of key's hash */
+	u32	klen;
+	u32	vlen;
+	u32	off;		/* heap offset / 8 */
+} pslot;
+
+typedef struct {
+	hash	hdr;
+	u64	seed;
+	u32	nbuckets;
+	u32	nslots;
+	u32	cnt;
+	int	lastidx;	/* for nextkey */
+	u16	*disp;		/* displacement for each bucket */
+	pslot	*slots;
+	u8	*heap;		/* data then key, 8-byte aligned */
+} perfhash;
+
+#define	ALIGN8(x)	(((x) + 7) & ~(size_t)7)
+
+private inline u64
+mix(u64 x)
+{
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93ULL;
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93ULL;
+	x ^= x >> 32;
+	return (x);
+}
+
+/*
+ * A 64-bit hash of the key.  crc32c isn't used here because two keys
+ * with the same crc would collide for every seed.
+ */
+private inline u64
+khash(u8 *p, int len, u64 seed)
+{
+	u64	w, h = seed ^ ((u64)len * 0x9e3779b97f4a7c15ULL);
+
+	while (len >= 8) {
+		memcpy(&w, p, 8);
+		h = mix(h ^ w);
+		p += 8;
+		len -= 8;
+	}
+	if (len) {
+		w = 0;
+		memcpy(&w, p, len);
+		h = mix(h ^ w);
+	}
+	return (h);
+}
+
+/* map a 32-bit value onto [0, n) without a divide */
+#define	RANGE(x, n)	((u32)(((u64)(u32)(x) * (n)) >> 32))
+
+private inline u32
+bucketof(perfhash *h, u64 x)
+{
+	return (RANGE(x >> 32, h->nbuckets));
+}
+
+private inline u32
+slotof(perfhash *h, u64 x, u32 d)
+{
+	return (RANGE(mix(x + d * 0x9e3779b97f4a7c15ULL), h->nslots));
+}
+
+private	int	place(perfhash *h, u64 *hashes, u32 n);
+
+/*
+ * usage: h = hash_new(HASH_PERFECT, src)
+ *
+ * Builds a read-only copy of the hash 'src'; see also hash_freeze().
+ * Returns 0 if no perfect hash could be found, which shouldn't happen
+ * unless 'src' has more than 2^32 keys.
+ */
+hash *
+perfhash_new(int flags, va_list ap)
+{
+	hash	*src = va_arg(ap, hash *);
+	perfhash	*h;
+	pslot	*recs;
+	u64	*hashes;
+	size_t	len;
+	u32	i, n;
+	int	try;
+
+	assert(src);
+	n = hash_count(src);
+	h = new(perfhash);
+	h->cnt = n;
+	h->nbuckets = n / LAMBDA + 1;
+	h->nslots = n / LOAD + 1;
+	h->disp = calloc(h->nbuckets, sizeof(u16));
+	h->slots = calloc(h->nslots, sizeof(pslot));
+
+	/* copy the data and keys into the heap */
+	len = 0;
+	EACH_HASH(src) len += ALIGN8(src->vlen + src->klen);
+	assert(len / 8 < EMPTY);
+	h->heap = malloc(len ? len : 1);
+	recs = malloc(n * sizeof(pslot));
+	len = i = 0;
+	EACH_HASH(src) {
+		memcpy(h->heap + len, src->vptr, src->vlen);
+		memcpy(h->heap + len + src->vlen, src->kptr, src->klen);
+		recs[i].klen = src->klen;
+		recs[i].vlen = src->vlen;
+		recs[i].off = len / 8;
+		len += ALIGN8(src->vlen + src->klen);
+		i++;
+	}
+	assert(i == n);
+
+	hashes = malloc(n * sizeof(u64));
+	for (try = 0; try < TRIES; try++) {
+		h->seed = mix(try + 1);
+		for (i = 0; i < n; i++) {
+			hashes[i] = khash(h->heap + recs[i].off * 8 + recs[i].vlen,
+			    recs[i].klen, h->seed);
+		}
+		unless (place(h, hashes, n)) break;
+	}
+	if (try < TRIES) {
+		/* place() left the index of each slot's key in off */
+		for (i = 0; i < h->nslots; i++) {
+			pslot	*s = &h->slots[i];
+			u32	k = s->off;
+
+			if (s->klen == EMPTY) continue;
+			*s = recs[k];
+			s->hash = hashes[k];
+		}
+	}
+	free(hashes);
+	free(recs);
+	if (try == TRIES) {
+		perfhash_free((hash *)h);
+		free(h);
+		errno = EINVAL;
+		return (0);
+	}
+	return ((hash *)h);
+}
+
+/*
+ * Find a displacement for every bucket.  Returns -1 if some bucket
+ * can't be placed with this seed.
+ */
+private int
+place(perfhash *h, u64 *hashes, u32 n)
+{
+	u32	*start, *order, *bysize, *keys;
+	u32	*pos;
+	u8	*taken;
+	u32	b, i, j, k, d, size, maxsize = 0;
+	int	rc = -1;
+
+	/* counting sort the keys by bucket */
+	start = calloc(h->nbuckets + 1, sizeof(u32));
+	for (i = 0; i < n; i++) start[bucketof(h, hashes[i]) + 1]++;
+	for (b = 0; b < h->nbuckets; b++) {
+		maxsize = max(maxsize, start[b+1]);
+		start[b+1] += start[b];
+	}
+	keys = malloc(n * sizeof(u32));
+	pos = calloc(h->nbuckets + 1, sizeof(u32));
+	for (i = 0; i < n; i++) {
+		b = bucketof(h, hashes[i]);
+		keys[start[b] + pos[b]++] = i;
+	}
+
+	/* and the buckets by size, biggest first */
+	bysize = calloc(maxsize + 2, sizeof(u32));
+	for (b = 0; b < h->nbuckets; b++) {
+		bysize[maxsize - (start[b+1] - start[b]) + 1]++;
+	}
+	for (i = 0; i <= maxsize; i++) bysize[i+1] += bysize[i];
+	order = malloc(h->nbuckets * sizeof(u32));
+	for (b = 0; b < h->nbuckets; b++) {
+		order[bysize[maxsize - (start[b+1] - start[b])]++] = b;
+	}
+
+	taken = calloc(h->nslots, 1);
+	pos = realloc(pos, (maxsize + 1) * sizeof(u32));
+	memset(h->disp, 0, h->nbuckets * sizeof(u16));
+	for (i = 0; i < h->nbuckets; i++) {
+		b = order[i];
+		unless (size = start[b+1] - start[b]) break;
+		for (d = 0; d <= MAXD; d++) {
+			for (j = 0; j < size; j++) {
+				pos[j] = slotof(h, hashes[keys[start[b]+j]], d);
+				if (taken[pos[j]]) break;
+				for (k = 0; k < j; k++) {
+					if (pos[k] == pos[j]) break;
+				}
+				if (k < j) break;
+			}
+			if (j == size) break;
+		}
+		if (d > MAXD) goto out;
+		h->disp[b] = d;
+		for (j = 0; j < size; j++) {
+			taken[pos[j]] = 1;
+			h->slots[pos[j]].klen = 0;
+			h->slots[pos[j]].off = keys[start[b]+j];
+		}
+	}
+	for (i = 0; i < h->nslots; i++) {
+		unless (taken[i]) h->slots[i].klen = EMPTY;
+	}
+	rc = 0;
+out:	free(start);
+	free(keys);
+	free(pos);
+	free(bysize);
+	free(order);
+	free(taken);
+	return (rc);
+}
+
+int
+perfhash_free(hash *_h)
+{
+	perfhash	*h = (perfhash *)_h;
+
+	free(h->disp);
+	free(h->slots);
+	free(h->heap);
+	return (0);
+}
+
+private inline void
+setptrs(perfhash *h, pslot *s)
+{
+	h->hdr.vptr = h->heap + (size_t)s->off * 8;
+	h->hdr.vlen = s->vlen;
+	h->hdr.kptr = h->heap + (size_t)s->off * 8 + s->vlen;
+	h->hdr.klen = s->klen;
+}
+
+void *
+perfhash_fetch(hash *_h, void *kptr, int klen)
+{
+	perfhash	*h = (perfhash *)_h;
+	u64	x = khash(kptr, klen, h->seed);
+	pslot	*s;
+
+	s = &h->slots[slotof(h, x, h->disp[bucketof(h, x)])];
+	/* klen first, an empty slot's hash means nothing */
+	if ((s->klen == klen) && (s->hash == (u32)x) &&
+	    !memcmp(h->heap + (size_t)s->off * 8 + s->vlen, kptr, klen)) {
+		setptrs(h, s);
+		return (h->hdr.vptr);
+	}
+	h->hdr.kptr = h->hdr.vptr = 0;
+	h->hdr.klen = h->hdr.vlen = 0;
+	errno = EINVAL;
+	return (0);
+}
+
+void *
+perfhash_store(hash *h, void *kptr, int klen, void *val, int vlen)
+{
+	errno = EROFS;
+	return (0);
+}
+
+int
+perfhash_delete(hash *h, void *kptr, int klen)
+{
+	errno = EROFS;
+	return (-1);
+}
+
+void *
+perfhash_first(hash *_h)
+{
+	perfhash	*h = (perfhash *)_h;
+
+	h->lastidx = -1;
+	return (perfhash_next(_h));
+}
+
+void *
+perfhash_next(hash *_h)
+{
+	perfhash	*h = (perfhash *)_h;
+	int	n;
+
+	n = h->lastidx + 1;
+	while ((n < h->nslots) && (h->slots[n].klen == EMPTY)) ++n;
+	h->lastidx = n;
+	if (n < h->nslots) {
+		setptrs(h, &h->slots[n]);
+	} else {
+		h->hdr.kptr = h->hdr.vptr = 0;
+	}
+	return (h->hdr.kptr);
+}
+
+int
+perfhash_count(hash *_h)
+{
+	perfhash	*h = (perfhash *)_h;
+
+	return (h->cnt);
+}
+
+int
+perfhash_stats(hash *_h, hashstats *s)
+{
+	perfhash	*h = (perfhash *)_h;
+	u32	i;
+
+	s->slots = h->nslots;
+	s->maxprobe = h->cnt ? 1 : 0;
+	s->meanprobe = s->maxprobe;
+	s->bytes = sizeof(perfhash) + h->nbuckets * sizeof(u16) +
+	    (u64)h->nslots * sizeof(pslot);
+	for (i = 0; i < h->nslots; i++) {
+		if (h->slots[i].klen == EMPTY) continue;
+		s->bytes += ALIGN8(h->slots[i].vlen + h->slots[i].klen);
+	}
+	return (0);
+}
+
+/*
+ * Return a read-only copy of 'h' that finds every key with a single
+ * probe.  For hashes that are built once and then only read.  The
+ * data can still be modified in place through the pointers returned
+ * by hash_fetch().  Free with hash_free().
+ */
+hash *
+hash_freeze(hash *h)
+{
+	return (hash_new(HASH_PERFECT, h));
+}
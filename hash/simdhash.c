@@ -0,0 +1,477 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "simdhash.h"
+#include "hashfn.h"
+
+#ifdef	__SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * An open-addressing hash for arbitrary keys and data.
+ *
+ * The table is split into groups of 16 slots.  Next to the slots is
+ * a 'ctrl' array with one byte per slot.  A full slot has a 7-bit
+ * tag from the key's hash in its ctrl byte, and empty and deleted
+ * slots have the high bit set.  A lookup compares the tag against
+ * all 16 ctrl bytes of a group at once and only looks at slots that
+ * match, so most misses never touch the slots at all.
+ *
+ * The slots keep the full hash and the key length so the key itself
+ * is only compared when those match.  The key and data for each item
+ * are kept in one malloc'ed buffer.  Like memhash those buffers don't
+ * move after they are created, but unlike memhash a store() that
+ * grows the data will move them.
+ */
+
+#define	GROUP		16		/* slots per group */
+#define	CTRL_EMPTY	0x80
+#define	CTRL_DELETED	0xfe
+
+#define	HASH(h, buf, len) hashfn((h)->fn, buf, len)
+#define	TAG(hash)	((hash) & 0x7f)
+#define	GIDX(hash)	((hash) >> 7)
+
+typedef struct {
+	u32	hash;		/* full hash of key */
+	u32	klen;		/* key len */
+	u32	dlen;		/* data len */
+	char	*key;		/* key and data stored here */
+} slot;
+
+typedef struct {
+	hash	hdr;		/* std header for hash_* wrappers */
+	u8	*ctrl;		/* tag byte for each slot */
+	slot	*slots;		/* the table */
+	u32	size;		/* number of slots, multiple of GROUP */
+	u32	cnt;		/* number of items in hash */
+	u32	used;		/* items + deleted slots */
+	int	fn;		/* HASH_FN_* for keys */
+
+	/* for nextkey .. */
+	int	lastidx;
+} simdhash;
+
+/*
+ * Find the offset of the data in the key array given the klen and
+ * dlen.  Same alignment rules as memhash.
+ */
+private inline int
+DOFF(int klen, int dlen)
+{
+	int	mask;
+
+	if ((sizeof(void*) == 8) && (dlen >= 8)) {
+		mask = 8-1;
+	} else if (dlen >= 4) {
+		mask = 4-1;
+	} else if (dlen >= 2) {
+		mask = 2-1;
+	} else {
+		/* no alignment */
+		return (klen);
+	}
+	return ((klen + mask) & ~mask);
+}
+
+/*
+ * Return a bitmask of the slots in a group whose ctrl byte equals 'c'
+ */
+private inline u32
+match(u8 *ctrl, u8 c)
+{
+#ifdef	__SSE2__
+	__m128i	g = _mm_loadu_si128((__m128i *)ctrl);
+
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c))));
+#else
+	u32	ret = 0;
+	int	i;
+
+	for (i = 0; i < GROUP; i++) {
+		if (ctrl[i] == c) ret |= (1 << i);
+	}
+	return (ret);
+#endif
+}
+
+/*
+ * Return a bitmask of the empty or deleted slots in a group.
+ */
+private inline u32
+matchFree(u8 *ctrl)
+{
+#ifdef	__SSE2__
+	/* movemask collects the high bits, which only free slots have */
+	return (_mm_movemask_epi8(_mm_loadu_si128((__m128i *)ctrl)));
+#else
+	u32	ret = 0;
+	int	i;
+
+	for (i = 0; i < GROUP; i++) {
+		if (ctrl[i] & 0x80) ret |= (1 << i);
+	}
+	return (ret);
+#endif
+}
+
+private	void	resize(simdhash *h, u32 newsize);
+
+/*
+ * Create a new hash structure.
+ */
+hash *
+simdhash_new(int flags, va_list ap)
+{
+	simdhash	*h;
+
+	h = new(simdhash);
+	h->fn = flags & HASH_FNMASK;
+	h->size = 2 * GROUP;
+	h->ctrl = malloc(h->size);
+	memset(h->ctrl, CTRL_EMPTY, h->size);
+	h->slots = calloc(h->size, sizeof(slot));
+	return ((hash *)h);
+}
+
+int
+simdhash_free(hash *_h)
+{
+	simdhash	*h = (simdhash *)_h;
+	int	i;
+
+	for (i = 0; i < h->size; i++) {
+		unless (h->ctrl[i] & 0x80) free(h->slots[i].key);
+	}
+	free(h->ctrl);
+	free(h->slots);
+	return (0);
+}
+
+private inline void
+setkv(simdhash *h, slot *s)
+{
+	h->hdr.kptr = s->key;
+	h->hdr.klen = s->klen;
+	h->hdr.vptr = s->key + DOFF(s->klen, s->dlen);
+	h->hdr.vlen = s->dlen;
+}
+
+private inline void
+clearkv(simdhash *h)
+{
+	h->hdr.kptr = h->hdr.vptr = 0;
+	h->hdr.klen = h->hdr.vlen = 0;
+}
+
+/*
+ * Find a key in the hash and return its slot index, or -1 if the key
+ * isn't in the hash.  If 'freep' is set it returns the first free slot
+ * seen on the probe sequence, which is where the key should be added.
+ *
+ * Groups are probed quadratically (1, 2, 3, ... groups away), which
+ * visits every group since the number of groups is a power of 2.
+ */
+private inline int
+lookup(simdhash *h, u32 hash, void *kptr, int klen, int *freep)
+{
+	u32	gmask = h->size / GROUP - 1;
+	u32	g = GIDX(hash) & gmask;
+	u32	m, step = 0;
+	u8	*ctrl;
+	slot	*s;
+	int	i;
+
+	if (freep) *freep = -1;
+	while (1) {
+		ctrl = h->ctrl + g * GROUP;
+		m = match(ctrl, TAG(hash));
+		while (m) {
+			i = __builtin_ctz(m);
+			s = &h->slots[g * GROUP + i];
+			if ((s->hash == hash) && (s->klen == klen) &&
+			    !memcmp(s->key, kptr, klen)) {
+				return (g * GROUP + i);
+			}
+			m &= m - 1;
+		}
+		if ((m = matchFree(ctrl))) {
+			if (freep && (*freep < 0)) {
+				*freep = g * GROUP + __builtin_ctz(m);
+			}
+			/* an empty slot ends the probe sequence */
+			if (match(ctrl, CTRL_EMPTY)) return (-1);
+		}
+		g = (g + ++step) & gmask;
+	}
+}
+
+void *
+simdhash_fetch(hash *_h, void *kptr, int klen)
+{
+	simdhash	*h = (simdhash *)_h;
+	int	n;
+
+	if ((n = lookup(h, HASH(h, kptr, klen), kptr, klen, 0)) >= 0) {
+		setkv(h, &h->slots[n]);
+	} else {
+		clearkv(h);
+		errno = EINVAL;
+	}
+	return (h->hdr.vptr);
+}
+
+/*
+ * Put a new item in the free slot 'n' and return a pointer to the
+ * data.
+ */
+private void *
+new_slot(simdhash *h, int n, u32 hash, void *kptr, int klen, int dlen)
+{
+	slot	*s = &h->slots[n];
+
+	if (h->ctrl[n] == CTRL_EMPTY) ++h->used;
+	++h->cnt;
+	h->ctrl[n] = TAG(hash);
+	s->hash = hash;
+	s->klen = klen;
+	s->dlen = dlen;
+	s->key = malloc(DOFF(klen, dlen) + dlen);
+	memcpy(s->key, kptr, klen);
+	setkv(h, s);
+	return (h->hdr.vptr);
+}
+
+/*
+ * Make sure there is room for one more item.  If the table is mostly
+ * deleted slots then rehash in place, otherwise double it.
+ * Returns true if the table was rebuilt.
+ */
+private int
+grow(simdhash *h)
+{
+	/* keep at most 7/8 of the slots in use */
+	if (h->used + 1 <= h->size - h->size / 8) return (0);
+	if (h->cnt < h->size / 2) {
+		resize(h, h->size);
+	} else {
+		resize(h, 2 * h->size);
+	}
+	return (1);
+}
+
+void *
+simdhash_insert(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	simdhash	*h = (simdhash *)_h;
+	u32	hash = HASH(h, kptr, klen);
+	int	n, f;
+	void	*ret;
+
+	if ((n = lookup(h, hash, kptr, klen, &f)) >= 0) {
+		/* ret 0, but h->kptr points at existing data */
+		setkv(h, &h->slots[n]);
+		errno = EEXIST;
+		return (0);
+	}
+	if (grow(h)) lookup(h, hash, kptr, klen, &f);
+	ret = new_slot(h, f, hash, kptr, klen, dlen);
+	if (dlen) {
+		if (dptr) {
+			memcpy(ret, dptr, dlen);
+		} else {
+			memset(ret, 0, dlen);
+		}
+	}
+	return (ret);
+}
+
+void *
+simdhash_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	simdhash	*h = (simdhash *)_h;
+	u32	hash = HASH(h, kptr, klen);
+	int	n, f;
+	slot	*s;
+	void	*ret;
+
+	if ((n = lookup(h, hash, kptr, klen, &f)) >= 0) {
+		s = &h->slots[n];
+		if (dlen > s->dlen) {
+			s->key = realloc(s->key, DOFF(klen, dlen) + dlen);
+		}
+		s->dlen = dlen;
+		setkv(h, s);
+		ret = h->hdr.vptr;
+	} else {
+		if (grow(h)) lookup(h, hash, kptr, klen, &f);
+		ret = new_slot(h, f, hash, kptr, klen, dlen);
+	}
+	if (dlen) {
+		if (dptr) {
+			memmove(ret, dptr, dlen);
+		} else {
+			memset(ret, 0, dlen);
+		}
+	}
+	return (ret);
+}
+
+/*
+ * Delete hash entry.
+ *
+ * If the slot's group still has an empty slot then no probe sequence
+ * ever continued past this group, so the slot can go straight back to
+ * empty.  Otherwise it has to be marked as deleted.
+ */
+int
+simdhash_delete(hash *_h, void *kptr, int klen)
+{
+	simdhash	*h = (simdhash *)_h;
+	int	n;
+
+	unless ((n = lookup(h, HASH(h, kptr, klen), kptr, klen, 0)) >= 0) {
+		errno = ENOENT;
+		return (-1);
+	}
+	free(h->slots[n].key);
+	h->slots[n].key = 0;
+	if (match(h->ctrl + (n & ~(GROUP-1)), CTRL_EMPTY)) {
+		h->ctrl[n] = CTRL_EMPTY;
+		--h->used;
+	} else {
+		h->ctrl[n] = CTRL_DELETED;
+	}
+	--h->cnt;
+	return (0);
+}
+
+void *
+simdhash_first(hash *_h)
+{
+	simdhash	*h = (simdhash *)_h;
+
+	h->lastidx = -1;
+	return (simdhash_next(_h));
+}
+
+void *
+simdhash_next(hash *_h)
+{
+	simdhash	*h = (simdhash *)_h;
+	int	i;
+
+	i = h->lastidx + 1;
+	while ((i < h->size) && (h->ctrl[i] & 0x80)) i++;
+	if (i < h->size) {
+		h->lastidx = i;
+		setkv(h, &h->slots[i]);
+	} else {
+		h->lastidx = h->size;
+		clearkv(h);
+	}
+	return (h->hdr.kptr);
+}
+
+int
+simdhash_count(hash *_h)
+{
+	simdhash	*h = (simdhash *)_h;
+
+	return (h->cnt);
+}
+
+/*
+ * Here a probe is a group of 16 slots, so a key in the first group
+ * it hashes to takes 1 probe.
+ */
+int
+simdhash_stats(hash *_h, hashstats *s)
+{
+	simdhash	*h = (simdhash *)_h;
+	slot	*sl;
+	u64	sum = 0;
+	u32	gmask = h->size / GROUP - 1;
+	u32	g, step;
+	int	i;
+
+	s->slots = h->size;
+	s->bytes = sizeof(simdhash) + (u64)h->size * (1 + sizeof(slot));
+	for (i = 0; i < h->size; i++) {
+		if (h->ctrl[i] & 0x80) continue;
+		sl = &h->slots[i];
+		s->bytes += DOFF(sl->klen, sl->dlen) + sl->dlen;
+		g = GIDX(sl->hash) & gmask;
+		step = 0;
+		while (g != i / GROUP) g = (g + ++step) & gmask;
+		sum += step + 1;
+		if (step + 1 > s->maxprobe) s->maxprobe = step + 1;
+	}
+	if (h->cnt) s->meanprobe = (double)sum / h->cnt;
+	return (0);
+}
+
+/*
+ * Grow the table so 'n' keys fit without resizing again.
+ */
+int
+simdhash_reserve(hash *_h, int n)
+{
+	simdhash	*h = (simdhash *)_h;
+	u32	size = h->size;
+
+	while (n + 1 > size - size / 8) size *= 2;
+	if (size > h->size) resize(h, size);
+	return (0);
+}
+
+/*
+ * Rebuild the table with 'newsize' slots.  The hashes are saved in
+ * the slots so the keys don't need to be touched.
+ */
+private void
+resize(simdhash *h, u32 newsize)
+{
+	u8	*oldctrl = h->ctrl;
+	slot	*oldslots = h->slots;
+	u32	oldsize = h->size;
+	u32	gmask = newsize / GROUP - 1;
+	u32	g, m, step;
+	int	i, n;
+	STATS_START(t0);
+
+	h->size = newsize;
+	h->ctrl = malloc(newsize);
+	memset(h->ctrl, CTRL_EMPTY, newsize);
+	h->slots = calloc(newsize, sizeof(slot));
+	for (i = 0; i < oldsize; i++) {
+		if (oldctrl[i] & 0x80) continue;
+		g = GIDX(oldslots[i].hash) & gmask;
+		step = 0;
+		while (!(m = match(h->ctrl + g * GROUP, CTRL_EMPTY))) {
+			g = (g + ++step) & gmask;
+		}
+		n = g * GROUP + __builtin_ctz(m);
+		h->ctrl[n] = oldctrl[i];
+		h->slots[n] = oldslots[i];
+	}
+	h->used = h->cnt;
+	free(oldctrl);
+	free(oldslots);
+	STATS_END(&h->hdr, t0);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+hash	*simdhash_new(int flags, va_list ap);
+int	simdhash_free(hash *h);
+
+void	*simdhash_fetch(hash *h, void *kptr, int klen);
+void	*simdhash_insert(hash *h, void *kptr, int klen, void *val, int vlen);
+void	*simdhash_store(hash *h, void *kptr, int klen, void *val, int vlen);
+int	simdhash_delete(hash *h, void *kptr, int klen);
+
+void	*simdhash_first(hash *h);
+void	*simdhash_next(hash *h);
+
+int	simdhash_count(hash *h);
+int	simdhash_reserve(hash *h, int n);
+int	simdhash_stats(hash *h, hashstats *s);
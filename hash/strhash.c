@@ -0,0 +1,442 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "strhash.h"
+#include "hashfn.h"
+#include "lines/arena.h"
+
+/*
+ * A hash for lots of short keys, like the strings in a symbol table.
+ *
+ * The items are kept packed in one array of 32-byte entries.  Keys
+ * of up to INLINE bytes and data of up to 8 bytes are stored right in
+ * the entry, so there is no malloc or pointer to follow per key.
+ * Longer keys and data are carved out of an arena.
+ *
+ * The entries are found through a separate open-addressing index of
+ * (hash, entry number) pairs using linear probing.  A search only
+ * looks at an entry when the full hash matches, and then compares the
+ * key length and first 8 bytes before calling memcmp().  The index
+ * can be rebuilt from its own hashes so the entries don't keep them.
+ *
+ * Like u32hash, the pointers to keys and to data in the entry are only
+ * good until the next store, insert or delete.  Data in the arena
+ * doesn't move, but the space for deleted or replaced keys and data
+ * there isn't reused until the hash is freed.  Deleting the current
+ * item while walking the hash is allowed.
+ */
+
+#define	INLINE		16	/* longest key kept in the entry */
+#define	MINSIZE		16	/* smallest index */
+
+#define	HASH(h, buf, len) hashfn((h)->fn, buf, len)
+
+typedef struct {
+	u32	klen;
+	u32	dlen;
+	union {
+		char	key[INLINE];	/* klen <= INLINE */
+		struct {
+			u64	pfx;	/* first 8 bytes of the key */
+			char	*kptr;	/* whole key, in the arena */
+		};
+	};
+	union {
+		char	val[8];		/* dlen <= 8 */
+		char	*dptr;		/* data, in the arena */
+	};
+} ent;
+
+typedef struct {
+	u32	hash;
+	u32	idx;		/* 1 + index in ents[], 0 == empty */
+} islot;
+
+typedef struct {
+	hash	hdr;		/* std header for hash_* wrappers */
+	islot	*index;
+	u32	size;		/* slots in index, power of 2 */
+	ent	*ents;		/* the items, packed */
+	u32	cnt;		/* number of items in hash */
+	u32	space;		/* room in ents[] */
+	ARENA	arena;		/* long keys and all data */
+	int	fn;		/* HASH_FN_* for keys */
+	int	lastidx;	/* for nextkey, counts down */
+} strhash;
+
+#define	KEY(e)	(((e)->klen <= INLINE) ? (e)->key : (e)->kptr)
+#define	VAL(e)	(((e)->dlen <= 8) ? (e)->val : (e)->dptr)
+
+private	void	resize(strhash *h, u32 newsize);
+
+/*
+ * usage: h = hash_new(HASH_STRHASH)
+ */
+hash *
+strhash_new(int flags, va_list ap)
+{
+	strhash	*h;
+
+	h = new(strhash);
+	h->fn = flags & HASH_FNMASK;
+	h->size = MINSIZE;
+	h->index = calloc(h->size, sizeof(islot));
+	return ((hash *)h);
+}
+
+int
+strhash_free(hash *_h)
+{
+	strhash	*h = (strhash *)_h;
+
+	arena_free(&h->arena);
+	free(h->index);
+	free(h->ents);
+	return (0);
+}
+
+private inline void
+setkv(strhash *h, ent *e)
+{
+	h->hdr.kptr = KEY(e);
+	h->hdr.klen = e->klen;
+	h->hdr.vptr = VAL(e);
+	h->hdr.vlen = e->dlen;
+}
+
+private inline void
+clearkv(strhash *h)
+{
+	h->hdr.kptr = h->hdr.vptr = 0;
+	h->hdr.klen = h->hdr.vlen = 0;
+}
+
+private inline int
+keyeq(ent *e, void *kptr, int klen)
+{
+	u64	a, b;
+
+	if (e->klen != klen) return (0);
+	if (klen < 8) return (!memcmp(e->key, kptr, klen));
+
+	/* the first 8 bytes of a long key are in the same place */
+	memcpy(&a, e->key, 8);
+	memcpy(&b, kptr, 8);
+	if (a != b) return (0);
+	return (!memcmp(KEY(e) + 8, (char *)kptr + 8, klen - 8));
+}
+
+/*
+ * Return the index slot holding the key, or the empty slot where it
+ * should be added.
+ */
+private inline u32
+lookup(strhash *h, u32 hash, void *kptr, int klen)
+{
+	u32	mask = h->size - 1;
+	u32	i = hash & mask;
+	islot	*s;
+
+	while ((s = &h->index[i])->idx) {
+		if ((s->hash == hash) &&
+		    keyeq(&h->ents[s->idx - 1], kptr, klen)) {
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+	return (i);
+}
+
+void *
+strhash_fetch(hash *_h, void *kptr, int klen)
+{
+	strhash	*h = (strhash *)_h;
+	u32	i = lookup(h, HASH(h, kptr, klen), kptr, klen);
+
+	if (h->index[i].idx) {
+		setkv(h, &h->ents[h->index[i].idx - 1]);
+	} else {
+		clearkv(h);
+		errno = EINVAL;
+	}
+	return (h->hdr.vptr);
+}
+
+/*
+ * Set the data of 'e' to a copy of 'dptr', or zeros if dptr is null.
+ * 'dptr' may point at the old data.
+ */
+private void
+setdata(strhash *h, ent *e, void *dptr, int dlen)
+{
+	char	*p;
+
+	if (dlen <= 8) {
+		p = e->val;
+	} else if ((e->dlen > 8) && (dlen <= e->dlen)) {
+		p = e->dptr;
+	} else {
+		/* the old data stays put in case dptr points at it */
+		p = arena_alloc(&h->arena, dlen);
+	}
+	if (dlen) {
+		if (dptr) {
+			memmove(p, dptr, dlen);
+		} else {
+			memset(p, 0, dlen);
+		}
+	}
+	if (dlen > 8) e->dptr = p;
+	e->dlen = dlen;
+}
+
+/*
+ * Add a new item at the end of ents[] and point index slot 'i' at it.
+ */
+private void
+add(strhash *h, u32 i, u32 hash, void *kptr, int klen, void *dptr, int dlen)
+{
+	ent	*e, *old = 0;
+
+	if (h->cnt == h->space) {
+		/* kptr or dptr may point into ents[] so free it last */
+		old = h->ents;
+		h->space = max(2 * h->space, MINSIZE);
+		h->ents = malloc(h->space * sizeof(ent));
+		if (old) memcpy(h->ents, old, h->cnt * sizeof(ent));
+	}
+	e = &h->ents[h->cnt];
+	e->klen = klen;
+	e->dlen = 0;
+	if (klen <= INLINE) {
+		memcpy(e->key, kptr, klen);
+	} else {
+		e->kptr = arena_alloc(&h->arena, klen);
+		memcpy(e->kptr, kptr, klen);
+		memcpy(&e->pfx, kptr, 8);
+	}
+	setdata(h, e, dptr, dlen);
+	h->index[i].hash = hash;
+	h->index[i].idx = ++h->cnt;
+	setkv(h, e);
+	free(old);
+}
+
+/*
+ * Make room in the index for one more item.  Returns true if the
+ * index was rebuilt.
+ */
+private inline int
+grow(strhash *h)
+{
+	if (h->cnt + 1 <= 3 * h->size / 4) return (0);
+	resize(h, 2 * h->size);
+	return (1);
+}
+
+void *
+strhash_insert(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	strhash	*h = (strhash *)_h;
+	u32	hash = HASH(h, kptr, klen);
+	u32	i;
+
+	i = lookup(h, hash, kptr, klen);
+	if (h->index[i].idx) {
+		/* ret 0, but h->kptr points at existing data */
+		setkv(h, &h->ents[h->index[i].idx - 1]);
+		errno = EEXIST;
+		return (0);
+	}
+	if (grow(h)) i = lookup(h, hash, kptr, klen);
+	add(h, i, hash, kptr, klen, dptr, dlen);
+	return (h->hdr.vptr);
+}
+
+void *
+strhash_store(hash *_h, void *kptr, int klen, void *dptr, int dlen)
+{
+	strhash	*h = (strhash *)_h;
+	u32	hash = HASH(h, kptr, klen);
+	u32	i;
+	ent	*e;
+
+	i = lookup(h, hash, kptr, klen);
+	if (h->index[i].idx) {
+		e = &h->ents[h->index[i].idx - 1];
+		setdata(h, e, dptr, dlen);
+		setkv(h, e);
+	} else {
+		if (grow(h)) i = lookup(h, hash, kptr, klen);
+		add(h, i, hash, kptr, klen, dptr, dlen);
+	}
+	return (h->hdr.vptr);
+}
+
+/*
+ * Delete hash entry.
+ *
+ * The index slot is removed by shifting back the slots after it, so
+ * no tombstones are needed.  The last entry is moved into the hole in
+ * ents[] to keep it packed, and its index slot is updated to match.
+ */
+int
+strhash_delete(hash *_h, void *kptr, int klen)
+{
+	strhash	*h = (strhash *)_h;
+	u32	mask = h->size - 1;
+	u32	i, j, home, n, last;
+
+	i = lookup(h, HASH(h, kptr, klen), kptr, klen);
+	unless (h->index[i].idx) {
+		errno = ENOENT;
+		return (-1);
+	}
+	n = h->index[i].idx - 1;
+	j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		unless (h->index[j].idx) break;
+		home = h->index[j].hash & mask;
+
+		/* leave j alone if its home is cyclically in (i, j] */
+		if ((i <= j) ? ((i < home) && (home <= j))
+			     : ((i < home) || (home <= j))) {
+			continue;
+		}
+		h->index[i] = h->index[j];
+		i = j;
+	}
+	h->index[i].idx = 0;
+
+	last = --h->cnt;
+	if (n != last) {
+		h->ents[n] = h->ents[last];
+		i = HASH(h, KEY(&h->ents[n]), h->ents[n].klen) & mask;
+		while (h->index[i].idx != last + 1) i = (i + 1) & mask;
+		h->index[i].idx = n + 1;
+	}
+	return (0);
+}
+
+/*
+ * The items are walked from the end of ents[] so deleting the current
+ * one, which moves the last item into its place, doesn't skip any.
+ */
+void *
+strhash_first(hash *_h)
+{
+	strhash	*h = (strhash *)_h;
+
+	h->lastidx = h->cnt;
+	return (strhash_next(_h));
+}
+
+void *
+strhash_next(hash *_h)
+{
+	strhash	*h = (strhash *)_h;
+
+	if (h->lastidx > h->cnt) h->lastidx = h->cnt;
+	if (--h->lastidx >= 0) {
+		setkv(h, &h->ents[h->lastidx]);
+	} else {
+		h->lastidx = 0;
+		clearkv(h);
+	}
+	return (h->hdr.kptr);
+}
+
+int
+strhash_count(hash *_h)
+{
+	strhash	*h = (strhash *)_h;
+
+	return (h->cnt);
+}
+
+/*
+ * Make room for 'n' items without growing again.
+ */
+int
+strhash_reserve(hash *_h, int n)
+{
+	strhash	*h = (strhash *)_h;
+	u32	size = h->size;
+
+	while (n > 3 * size / 4) size *= 2;
+	if (size > h->size) resize(h, size);
+	if (n > h->space) {
+		h->space = n;
+		h->ents = realloc(h->ents, h->space * sizeof(ent));
+	}
+	return (0);
+}
+
+/*
+ * A key d slots past its home slot in the index takes d+1 probes.
+ */
+int
+strhash_stats(hash *_h, hashstats *s)
+{
+	strhash	*h = (strhash *)_h;
+	ent	*e;
+	u64	sum = 0;
+	u32	i, d;
+
+	s->slots = h->size;
+	s->bytes = sizeof(strhash) +
+	    h->size * sizeof(islot) + h->space * sizeof(ent);
+	for (i = 0; i < h->size; i++) {
+		unless (h->index[i].idx) continue;
+		d = ((i - h->index[i].hash) & (h->size - 1)) + 1;
+		sum += d;
+		if (d > s->maxprobe) s->maxprobe = d;
+	}
+	for (i = 0; i < h->cnt; i++) {
+		e = &h->ents[i];
+		if (e->dlen > 8) s->bytes += e->dlen;
+		if (e->klen > INLINE) s->bytes += e->klen;
+	}
+	if (h->cnt) s->meanprobe = (double)sum / h->cnt;
+	return (0);
+}
+
+/*
+ * Rebuild the index with 'newsize' slots from the old index, so the
+ * entries and keys aren't touched.
+ */
+private void
+resize(strhash *h, u32 newsize)
+{
+	islot	*old = h->index;
+	u32	oldsize = h->size;
+	u32	mask = newsize - 1;
+	u32	i, j;
+	STATS_START(t0);
+
+	h->size = newsize;
+	h->index = calloc(h->size, sizeof(islot));
+	for (i = 0; i < oldsize; i++) {
+		unless (old[i].idx) continue;
+		j = old[i].hash & mask;
+		while (h->index[j].idx) j = (j + 1) & mask;
+		h->index[j] = old[i];
+	}
+	free(old);
+	STATS_END(&h->hdr, t0);
+}
@@ -17,7 +17,7 @@
 #include "hash.h"
 #include "u32hash.h"
 
-#include "utils/crc32c.h"
+#include "hashfn.h"
 #include "lines/data.h"
 
 typedef	struct {
@@ -30,23 +30,37 @@ typedef struct {
 	keyval	*table;	   /* hash-table contain key/val pairs */
 	u32	size;      /* number of u32's in table */
 	u32	cnt;	   /* number of items in hash  */
+	u32	freevals;  /* 1 + offset of first deleted vals record */
+	int	fn;	   /* HASH_FN_* for keys */
+
+	/* HASH_INCREMENTAL: the table being moved to 'table' */
+	keyval	*oldtable; /* old table, 0 if not resizing */
+	u32	oldsize;   /* number of u32's in oldtable */
+	u32	migrate;   /* oldtable slots below this have been moved */
+	u8	incremental; /* resize a few slots at a time */
+
 	DATA	vals[0];   /* data storage */
 } u32hash;
 
-#define	HASH(buf, len) crc32c(0, buf, len)
+/* HASH_INCREMENTAL: number of old slots moved per operation */
+#define	MIGRATE_STEP	16
+
+/* number of keys in flight in fetchBatch/storeBatch */
+#define	BATCH		16
 
 #define	VPTR(h, n) (((h)->hdr.vlen > sizeof(u32))		\
 	    ? (void *)((h)->vals[0].buf + h->table[n].val)	\
 	    : (void *)&(h)->table[n].val)
 
-private	void	resize(u32hash *h);
+private	void	resize(u32hash *h, u32 newsize);
+private	void	migrate(u32hash *h, u32 cnt);
 
 /*
  * usage: h = hash_new(HASH_U32, sizeof(u32), sizeof(value))
  *
  */
 hash *
-u32hash_new(va_list ap)
+u32hash_new(int flags, va_list ap)
 {
 	u32hash	*h;
 	u32	klen, vlen;
@@ -65,6 +79,8 @@ u32hash_new(va_list ap)
 	h->hdr.vlen = vlen;	/* never changes */
 	h->size = 32;
 	h->table = calloc(h->size, sizeof(*h->table));
+	if (flags & HASH_INCREMENTAL) h->incremental = 1;
+	h->fn = flags & HASH_FNMASK;
 
 	return ((hash *)h);
 }
@@ -75,18 +91,56 @@ u32hash_free(hash *_h)
 	u32hash	*h = (u32hash *)_h;
 
 	free(h->table);
+	free(h->oldtable);
 	if (h->hdr.vlen > sizeof(u32)) free(h->vals[0].buf);
 	return (0);
 }
 
-private int
-lookup(u32hash *h, u32 key)
+private inline u32
+khash(u32hash *h, u32 key)
+{
+	/* the default integer mix stays inline in the lookup */
+	switch (h->fn) {
+	    case HASH_FN_DEFAULT:
+	    case HASH_FN_INT:
+		return (hashfn_u32(key));
+	    default:
+		return (hashfn(h->fn, &key, sizeof(key)));
+	}
+}
+
+/*
+ * Return the slot in 'table' holding 'key' or the empty slot where
+ * it would go.  'hash' is khash(h, key).
+ */
+private inline int
+probe(keyval *table, u32 size, u32 key, u32 hash)
 {
 	int	n;
 
-	n = HASH(&key, sizeof(key)) & (h->size - 1);
-	while (h->table[n].key && (h->table[n].key != key)) {
-		n = (n + 1) & (h->size - 1);
+	n = hash & (size - 1);
+	while (table[n].key && (table[n].key != key)) {
+		n = (n + 1) & (size - 1);
+	}
+	return (n);
+}
+
+private int
+lookup_hash(u32hash *h, u32 key, u32 hash)
+{
+	int	n, i;
+
+	n = probe(h->table, h->size, key, hash);
+	if (!h->table[n].key && h->oldtable) {
+		/*
+		 * An incremental resize is running.  If the key is in
+		 * the part of the old table that hasn't been moved yet,
+		 * move it now so the caller only sees the new table.
+		 */
+		i = probe(h->oldtable, h->oldsize, key, hash);
+		if (h->oldtable[i].key && (i >= h->migrate)) {
+			h->table[n] = h->oldtable[i];
+		}
 	}
 	if (h->table[n].key) {
 		h->hdr.kptr = &h->table[n].key;
@@ -98,6 +152,12 @@ lookup(u32hash *h, u32 key)
 	return (n);
 }
 
+private inline int
+lookup(u32hash *h, u32 key)
+{
+	return (lookup_hash(h, key, khash(h, key)));
+}
+
 void *
 u32hash_fetch(hash *_h, void *kptr, int klen)
 {
@@ -106,6 +166,7 @@ u32hash_fetch(hash *_h, void *kptr, int klen)
 
 	assert(klen == sizeof(u32));
 	key = *(u32 *)kptr;
+	if (h->oldtable) migrate(h, MIGRATE_STEP);
 	lookup(h, key);
 	return (h->hdr.vptr);
 }
@@ -124,7 +185,8 @@ u32hash_insert(hash *_h, void *kptr, int klen, void *vptr, int vlen)
 	assert(key != 0);	/* sorry 0 can't be a key */
 
 	// resize at 75% full
-	if (h->cnt > 3 * h->size / 4) resize(h);
+	if (h->oldtable) migrate(h, MIGRATE_STEP);
+	if (h->cnt > 3 * h->size / 4) resize(h, 2 * h->size);
 
 	n = lookup(h, key);
 	if (h->hdr.vptr) {
@@ -138,9 +200,17 @@ u32hash_insert(hash *_h, void *kptr, int klen, void *vptr, int vlen)
 		h->hdr.kptr = &h->table[n].key;
 
 		if (h->hdr.vlen > sizeof(u32)) {
-			h->table[n].val = h->vals[0].len;
-			h->vals[0].len += vlen;
-			data_resize(&h->vals[0], h->vals[0].len);
+			if (h->freevals) {
+				/* reuse a deleted record */
+				h->table[n].val = h->freevals - 1;
+				memcpy(&h->freevals,
+				    h->vals[0].buf + h->table[n].val,
+				    sizeof(u32));
+			} else {
+				h->table[n].val = h->vals[0].len;
+				h->vals[0].len += vlen;
+				data_resize(&h->vals[0], h->vals[0].len);
+			}
 			h->hdr.vptr = h->vals[0].buf + h->table[n].val;
 			if (vptr) {
 				memcpy(h->hdr.vptr, vptr, vlen);
@@ -170,11 +240,122 @@ u32hash_store(hash *_h, void *kptr, int klen, void *vptr, int vlen)
 	return (_h->vptr);
 }
 
+/*
+ * Delete a key using backward-shift deletion.
+ *
+ * Rather than leaving a tombstone, the following items in the probe
+ * run are moved back into the hole when that doesn't put them before
+ * their home slot.  The table ends up as if the key had never been
+ * added, so probe lengths don't degrade with churn.
+ *
+ * Deleting items from inside an EACH_HASH() loop is not supported
+ * as items can move to slots that were already walked.
+ */
+int
+u32hash_delete(hash *_h, void *kptr, int klen)
+{
+	u32hash	*h = (u32hash *)_h;
+	u32	mask = h->size - 1;
+	u32	i, j, home;
+
+	assert(klen == sizeof(u32));
+	/* only delete from one table */
+	if (h->oldtable) migrate(h, h->oldsize);
+	i = lookup(h, *(u32 *)kptr);
+	unless (h->hdr.kptr) {
+		errno = ENOENT;
+		return (-1);
+	}
+	if (h->hdr.vlen > sizeof(u32)) {
+		/* put the data record on the free list */
+		memcpy(h->vals[0].buf + h->table[i].val,
+		    &h->freevals, sizeof(u32));
+		h->freevals = h->table[i].val + 1;
+	}
+	j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		unless (h->table[j].key) break;
+		home = khash(h, h->table[j].key) & mask;
+
+		/* leave j alone if its home is cyclically in (i, j] */
+		if ((i <= j) ? ((i < home) && (home <= j))
+			     : ((i < home) || (home <= j))) {
+			continue;
+		}
+		h->table[i] = h->table[j];
+		i = j;
+	}
+	h->table[i].key = 0;
+	h->table[i].val = 0;
+	--h->cnt;
+	h->hdr.kptr = h->hdr.vptr = 0;
+	return (0);
+}
+
+/*
+ * Fetch n keys at once.  All keys in a batch are hashed and their home
+ * slots prefetched before any of them are looked up.
+ * See memhash_fetchBatch().
+ */
+int
+u32hash_fetchBatch(hash *_h, void **keys, int *klens, int n, void **out)
+{
+	u32hash	*h = (u32hash *)_h;
+	u32	hashes[BATCH];
+	int	i, j, cnt, found = 0;
+
+	for (i = 0; i < n; i += BATCH) {
+		cnt = min(BATCH, n - i);
+		if (h->oldtable) migrate(h, MIGRATE_STEP);
+		for (j = 0; j < cnt; j++) {
+			assert(klens[i+j] == sizeof(u32));
+			hashes[j] = khash(h, *(u32 *)keys[i+j]);
+			__builtin_prefetch(&h->table[hashes[j] & (h->size - 1)]);
+		}
+		for (j = 0; j < cnt; j++) {
+			lookup_hash(h, *(u32 *)keys[i+j], hashes[j]);
+			if ((out[i+j] = h->hdr.vptr)) ++found;
+		}
+	}
+	return (found);
+}
+
+/*
+ * Store n keys at once.  The home slots of a batch are prefetched
+ * first.  Since stores can move the data, pointers returned in 'out'
+ * for earlier keys may be invalid by the time this returns.
+ */
+int
+u32hash_storeBatch(hash *_h, void **keys, int *klens,
+    void **vals, int *vlens, int n, void **out)
+{
+	u32hash	*h = (u32hash *)_h;
+	int	i, j, cnt;
+	void	*ret;
+
+	for (i = 0; i < n; i += BATCH) {
+		cnt = min(BATCH, n - i);
+		for (j = 0; j < cnt; j++) {
+			__builtin_prefetch(&h->table[
+			    khash(h, *(u32 *)keys[i+j]) & (h->size - 1)]);
+		}
+		for (j = 0; j < cnt; j++) {
+			ret = u32hash_store(_h, keys[i+j], klens[i+j],
+			    vals ? vals[i+j] : 0, vlens[i+j]);
+			if (out) out[i+j] = ret;
+		}
+	}
+	return (n);
+}
+
 void *
 u32hash_first(hash *_h)
 {
 	u32hash	*h = (u32hash *)_h;
 
+	/* walking the hash only looks at the new table */
+	if (h->oldtable) migrate(h, h->oldsize);
 	h->hdr.kptr = &h->table[0].key;
 	if (h->table[0].key) {
 		h->hdr.vptr = VPTR(h, 0);
@@ -219,14 +400,72 @@ u32hash_count(hash *_h)
 	return (h->cnt);
 }
 
+/*
+ * A key d slots past its home slot takes d+1 probes.  Keys still in
+ * the old table of an incremental resize aren't counted.
+ */
+int
+u32hash_stats(hash *_h, hashstats *s)
+{
+	u32hash	*h = (u32hash *)_h;
+	u64	sum = 0;
+	u32	i, d, n = 0;
+
+	s->slots = h->size;
+	s->bytes = sizeof(u32hash) + h->size * sizeof(keyval);
+	if (h->oldtable) s->bytes += h->oldsize * sizeof(keyval);
+	if (h->hdr.vlen > sizeof(u32)) s->bytes += sizeof(DATA) + h->vals[0].size;
+	for (i = 0; i < h->size; i++) {
+		unless (h->table[i].key) continue;
+		d = ((i - khash(h, h->table[i].key)) & (h->size - 1)) + 1;
+		sum += d;
+		if (d > s->maxprobe) s->maxprobe = d;
+		n++;
+	}
+	if (n) s->meanprobe = (double)sum / n;
+	return (0);
+}
+
+/*
+ * Grow the table so 'n' keys fit without resizing again.
+ */
+int
+u32hash_reserve(hash *_h, int n)
+{
+	u32hash	*h = (u32hash *)_h;
+	u32	size = h->size;
+
+	while (n > 3 * size / 4) size *= 2;
+	if (size > h->size) resize(h, size);
+	return (0);
+}
+
+/*
+ * Grow the table to 'newsize' slots.
+ *
+ * With HASH_INCREMENTAL the old table is kept and migrate() moves a
+ * few slots at a time on each following operation.  Keys still in the
+ * unmoved part of the old table are found by lookup().
+ */
 private void
-resize(u32hash *h)
+resize(u32hash *h, u32 newsize)
 {
 	u32	oldsize = h->size;
 	keyval	*oldtable = h->table;
 	int	i, n;
+	STATS_START(t0);
 
-	h->size = 2*oldsize;
+	if (h->incremental) {
+		if (h->oldtable) migrate(h, h->oldsize);
+		h->oldtable = oldtable;
+		h->oldsize = oldsize;
+		h->migrate = 0;
+		h->size = newsize;
+		h->table = calloc(h->size, sizeof(*h->table));
+		STATS_END(&h->hdr, t0);
+		return;
+	}
+	h->size = newsize;
 	h->table = calloc(h->size, sizeof(*h->table));
 	for (i = 0; i < oldsize; ++i) {
 		unless (oldtable[i].key) continue;
@@ -234,4 +473,29 @@ resize(u32hash *h)
 		h->table[n] = oldtable[i];	/* copy key and val */
 	}
 	free(oldtable);
+	STATS_END(&h->hdr, t0);
+}
+
+/*
+ * Move up to 'cnt' slots from the old table to the new one and free
+ * the old table when done.  Keys that lookup() already moved are
+ * skipped.  The old table is never modified so its probe sequences
+ * stay intact until it is freed.
+ */
+private void
+migrate(u32hash *h, u32 cnt)
+{
+	keyval	*kv;
+	int	n;
+
+	while (cnt-- && (h->migrate < h->oldsize)) {
+		kv = &h->oldtable[h->migrate++];
+		unless (kv->key) continue;
+		n = probe(h->table, h->size, kv->key, khash(h, kv->key));
+		unless (h->table[n].key) h->table[n] = *kv;
+	}
+	if (h->migrate >= h->oldsize) {
+		free(h->oldtable);
+		h->oldtable = 0;
+	}
 }
@@ -14,14 +14,20 @@
  * limitations under the License.
  */
 
-hash	*u32hash_new(va_list ap);
+hash	*u32hash_new(int flags, va_list ap);
 int	u32hash_free(hash *h);
 
 void	*u32hash_fetch(hash *h, void *kptr, int klen);
 void	*u32hash_insert(hash *h, void *kptr, int klen, void *val, int vlen);
 void	*u32hash_store(hash *h, void *kptr, int klen, void *val, int vlen);
+int	u32hash_delete(hash *h, void *kptr, int klen);
+int	u32hash_fetchBatch(hash *h, void **keys, int *klens, int n, void **out);
+int	u32hash_storeBatch(hash *h, void **keys, int *klens,
+	    void **vals, int *vlens, int n, void **out);
 
 void	*u32hash_first(hash *h);
 void	*u32hash_next(hash *h);
 
 int	u32hash_count(hash *h);
+int	u32hash_reserve(hash *h, int n);
+int	u32hash_stats(hash *h, hashstats *s);
@@ -0,0 +1,351 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include "u64hash.h"
+
+#include "hashfn.h"
+#include "lines/data.h"
+
+/*
+ * A linear-probing hash for 8-byte keys and fixed size values.
+ *
+ * Each slot is the key followed by the value rounded up to 8 bytes,
+ * so a fetch only touches one slot.  Values bigger than INLINE bytes
+ * are kept in a side DATA buffer like u32hash and the slot holds the
+ * offset instead.
+ *
+ * A zero key marks an empty slot.  Since zero is a perfectly good key
+ * too, it is kept in one extra slot past the end of the table.
+ */
+
+#define	INLINE	16		/* largest value kept in the slot */
+
+typedef struct {
+	hash	hdr;
+	u8	*table;	   /* hash-table of slots */
+	u32	size;      /* number of slots in table */
+	u32	cnt;	   /* number of items in hash  */
+	u32	stride;	   /* bytes per slot */
+	int	haszero;   /* key 0 is in SLOT(h, size) */
+	u32	freevals;  /* 1 + offset of first deleted vals record */
+	int	fn;	   /* HASH_FN_* for keys */
+	int	lastidx;   /* for nextkey */
+	DATA	vals;	   /* data storage for big values */
+} u64hash;
+
+#define	SLOT(h, n)	((h)->table + (size_t)(n) * (h)->stride)
+#define	KEY(h, n)	(*(u64 *)SLOT(h, n))
+#define	VOFF(h, n)	(*(u32 *)(SLOT(h, n) + sizeof(u64)))
+#define	VPTR(h, n) (((h)->hdr.vlen > INLINE)				\
+	    ? (void *)((h)->vals.buf + VOFF(h, n))			\
+	    : (void *)(SLOT(h, n) + sizeof(u64)))
+
+private	void	resize(u64hash *h, u32 newsize);
+
+/*
+ * usage: h = hash_new(HASH_U64HASH, sizeof(u64), sizeof(value))
+ */
+hash *
+u64hash_new(int flags, va_list ap)
+{
+	u64hash	*h;
+	u32	klen, vlen;
+
+	klen = va_arg(ap, u32);
+	assert(klen == sizeof(u64));
+	vlen = va_arg(ap, u32);
+
+	h = new(u64hash);
+	h->hdr.klen = klen;	/* never changes */
+	h->hdr.vlen = vlen;	/* never changes */
+	h->fn = flags & HASH_FNMASK;
+	h->stride = sizeof(u64) +
+	    ((vlen > INLINE) ? sizeof(u64) : ((vlen + 7) & ~7));
+	h->size = 32;
+	h->table = calloc(h->size + 1, h->stride);
+	return ((hash *)h);
+}
+
+int
+u64hash_free(hash *_h)
+{
+	u64hash	*h = (u64hash *)_h;
+
+	free(h->table);
+	free(h->vals.buf);
+	return (0);
+}
+
+private inline u32
+home(u64hash *h, u64 key)
+{
+	u32	x;
+
+	switch (h->fn) {
+	    case HASH_FN_DEFAULT:
+	    case HASH_FN_INT:
+		x = hashfn_u64(key);
+		break;
+	    default:
+		x = hashfn(h->fn, &key, sizeof(key));
+		break;
+	}
+	return (x & (h->size - 1));
+}
+
+/*
+ * Return the slot holding 'key' or the empty slot where it would go.
+ * Sets kptr/vptr if the key was found.
+ */
+private int
+lookup(u64hash *h, u64 key)
+{
+	u32	n;
+	int	found;
+
+	if (key) {
+		n = home(h, key);
+		while (KEY(h, n) && (KEY(h, n) != key)) {
+			n = (n + 1) & (h->size - 1);
+		}
+		found = (KEY(h, n) != 0);
+	} else {
+		n = h->size;
+		found = h->haszero;
+	}
+	if (found) {
+		h->hdr.kptr = SLOT(h, n);
+		h->hdr.vptr = VPTR(h, n);
+	} else {
+		h->hdr.kptr = 0;
+		h->hdr.vptr = 0;
+	}
+	return (n);
+}
+
+void *
+u64hash_fetch(hash *_h, void *kptr, int klen)
+{
+	u64hash	*h = (u64hash *)_h;
+
+	assert(klen == sizeof(u64));
+	lookup(h, *(u64 *)kptr);
+	return (h->hdr.vptr);
+}
+
+void *
+u64hash_insert(hash *_h, void *kptr, int klen, void *vptr, int vlen)
+{
+	u64hash	*h = (u64hash *)_h;
+	u32	n, off;
+	u64	key;
+
+	assert(klen == h->hdr.klen);
+	assert(vlen == h->hdr.vlen);
+	memcpy(&key, kptr, sizeof(key));
+
+	// resize at 75% full
+	if (h->cnt > 3 * h->size / 4) resize(h, 2 * h->size);
+
+	n = lookup(h, key);
+	if (h->hdr.kptr) {
+		/* found one */
+		errno = EEXIST;
+		return (0);
+	}
+	++h->cnt;
+	KEY(h, n) = key;
+	if (n == h->size) h->haszero = 1;
+	if (vlen > INLINE) {
+		if (h->freevals) {
+			/* reuse a deleted record */
+			off = h->freevals - 1;
+			memcpy(&h->freevals, h->vals.buf + off, sizeof(u32));
+		} else {
+			off = h->vals.len;
+			h->vals.len += vlen;
+			data_resize(&h->vals, h->vals.len);
+		}
+		VOFF(h, n) = off;
+	}
+	h->hdr.kptr = SLOT(h, n);
+	h->hdr.vptr = VPTR(h, n);
+	if (vptr) {
+		memcpy(h->hdr.vptr, vptr, vlen);
+	} else {
+		memset(h->hdr.vptr, 0, vlen);
+	}
+	return (h->hdr.vptr);
+}
+
+void *
+u64hash_store(hash *_h, void *kptr, int klen, void *vptr, int vlen)
+{
+	unless (u64hash_insert(_h, kptr, klen, vptr, vlen)) {
+		/* existing node, overwrite */
+		if (vptr) {
+			memcpy(_h->vptr, vptr, vlen);
+		} else {
+			memset(_h->vptr, 0, vlen);
+		}
+	}
+	return (_h->vptr);
+}
+
+/*
+ * Backward-shift deletion, see u32hash_delete().
+ */
+int
+u64hash_delete(hash *_h, void *kptr, int klen)
+{
+	u64hash	*h = (u64hash *)_h;
+	u32	mask = h->size - 1;
+	u32	i, j, k;
+
+	assert(klen == sizeof(u64));
+	i = lookup(h, *(u64 *)kptr);
+	unless (h->hdr.kptr) {
+		errno = ENOENT;
+		return (-1);
+	}
+	if (h->hdr.vlen > INLINE) {
+		/* put the data record on the free list */
+		memcpy(h->vals.buf + VOFF(h, i), &h->freevals, sizeof(u32));
+		h->freevals = VOFF(h, i) + 1;
+	}
+	--h->cnt;
+	h->hdr.kptr = h->hdr.vptr = 0;
+	if (i == h->size) {
+		h->haszero = 0;
+		return (0);
+	}
+	j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		unless (KEY(h, j)) break;
+		k = home(h, KEY(h, j));
+
+		/* leave j alone if its home is cyclically in (i, j] */
+		if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) {
+			continue;
+		}
+		memcpy(SLOT(h, i), SLOT(h, j), h->stride);
+		i = j;
+	}
+	KEY(h, i) = 0;
+	return (0);
+}
+
+void *
+u64hash_first(hash *_h)
+{
+	u64hash	*h = (u64hash *)_h;
+
+	h->lastidx = -1;
+	return (u64hash_next(_h));
+}
+
+void *
+u64hash_next(hash *_h)
+{
+	u64hash	*h = (u64hash *)_h;
+	int	n;
+
+	n = h->lastidx + 1;
+	while ((n < h->size) && !KEY(h, n)) ++n;
+	h->lastidx = n;
+	if ((n < h->size) || ((n == h->size) && h->haszero)) {
+		h->hdr.kptr = SLOT(h, n);
+		h->hdr.vptr = VPTR(h, n);
+	} else {
+		h->hdr.kptr = 0;
+		h->hdr.vptr = 0;
+	}
+	return (h->hdr.kptr);
+}
+
+int
+u64hash_count(hash *_h)
+{
+	u64hash	*h = (u64hash *)_h;
+
+	return (h->cnt);
+}
+
+/*
+ * A key d slots past its home slot takes d+1 probes.
+ */
+int
+u64hash_stats(hash *_h, hashstats *s)
+{
+	u64hash	*h = (u64hash *)_h;
+	u64	sum = 0;
+	u32	i, d;
+
+	s->slots = h->size;
+	s->bytes = sizeof(u64hash) + (u64)(h->size + 1) * h->stride +
+	    h->vals.size;
+	for (i = 0; i < h->size; i++) {
+		unless (KEY(h, i)) continue;
+		d = ((i - home(h, KEY(h, i))) & (h->size - 1)) + 1;
+		sum += d;
+		if (d > s->maxprobe) s->maxprobe = d;
+	}
+	if (h->haszero) {
+		sum++;
+		unless (s->maxprobe) s->maxprobe = 1;
+	}
+	if (h->cnt) s->meanprobe = (double)sum / h->cnt;
+	return (0);
+}
+
+int
+u64hash_reserve(hash *_h, int n)
+{
+	u64hash	*h = (u64hash *)_h;
+	u32	size = h->size;
+
+	while (n > 3 * size / 4) size *= 2;
+	if (size > h->size) resize(h, size);
+	return (0);
+}
+
+private void
+resize(u64hash *h, u32 newsize)
+{
+	u32	oldsize = h->size;
+	u8	*oldtable = h->table;
+	u64	key;
+	int	i, n;
+	STATS_START(t0);
+
+	h->size = newsize;
+	h->table = calloc(h->size + 1, h->stride);
+	for (i = 0; i < oldsize; ++i) {
+		key = *(u64 *)(oldtable + (size_t)i * h->stride);
+		unless (key) continue;
+		n = home(h, key);
+		while (KEY(h, n)) n = (n + 1) & (h->size - 1);
+		/* copy key and val */
+		memcpy(SLOT(h, n), oldtable + (size_t)i * h->stride, h->stride);
+	}
+	/* and key 0 */
+	memcpy(SLOT(h, h->size), oldtable + (size_t)oldsize * h->stride,
+	    h->stride);
+	free(oldtable);
+	STATS_END(&h->hdr, t0);
+}
@@ -30,7 +30,7 @@ typedef struct {
  * if mdbm==0, then create a new mdbm
  */
 hash *
-wrapmdbm_new(va_list ap)
+wrapmdbm_new(int flags, va_list ap)
 {
 	whash	*ret;
 
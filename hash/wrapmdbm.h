@@ -17,7 +17,7 @@
 #ifndef	_WRAPMDBM_H
 #define	_WRAPMDBM_H
 
-hash	*wrapmdbm_new(va_list ap);
+hash	*wrapmdbm_new(int flags, va_list ap);
 hash	*wrapmdbm_open(char *file, int flags, mode_t mode, va_list ap);
 int	wrapmdbm_close(hash *h);
 int	wrapmdbm_free(hash *h);
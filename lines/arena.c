@@ -0,0 +1,101 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "style.h"
+#include "arena.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define	ALIGN		8		/* alignment of all allocations */
+#define	MINCHUNK	(4 << 10)
+#define	MAXCHUNK	(1 << 20)
+
+struct achunk {
+	achunk	*next;
+	union {
+		char	data[0];	/* allocations start here */
+		u64	align;
+	};
+};
+
+/*
+ * Allocate 'len' bytes from the arena.  The memory is not cleared
+ * and is aligned for any type up to 8 bytes.
+ * Chunks start small and double up to MAXCHUNK so small arenas stay
+ * small.  Requests bigger than a quarter chunk get a chunk of their
+ * own so they don't waste the rest of the current one.
+ */
+void *
+arena_alloc(ARENA *a, size_t len)
+{
+	achunk	*c;
+	void	*ret;
+	size_t	size;
+
+	len = (len + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+	if (len > (size_t)(a->end - a->next)) {
+		unless (a->csize) a->csize = MINCHUNK;
+		if (len > a->csize / 4) {
+			c = malloc(sizeof(achunk) + len);
+			assert(c);
+			if (a->chunks) {
+				/* keep using the current chunk */
+				c->next = a->chunks->next;
+				a->chunks->next = c;
+			} else {
+				c->next = 0;
+				a->chunks = c;
+			}
+			return (c->data);
+		}
+		size = a->csize;
+		if (a->csize < MAXCHUNK) a->csize *= 2;
+		c = malloc(sizeof(achunk) + size);
+		assert(c);
+		c->next = a->chunks;
+		a->chunks = c;
+		a->next = c->data;
+		a->end = c->data + size;
+	}
+	ret = a->next;
+	a->next += len;
+	return (ret);
+}
+
+char *
+arena_strdup(ARENA *a, char *s)
+{
+	size_t	len = strlen(s) + 1;
+
+	return (memcpy(arena_alloc(a, len), s, len));
+}
+
+/*
+ * Release all memory in the arena, it can be reused after this.
+ */
+void
+arena_free(ARENA *a)
+{
+	achunk	*c, *t;
+
+	for (c = a->chunks; c; c = t) {
+		t = c->next;
+		free(c);
+	}
+	memset(a, 0, sizeof(*a));
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2026 BitMover, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef	_LIB_LINES_ARENA_H
+#define	_LIB_LINES_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * A bump allocator.  Memory is handed out from a list of large chunks
+ * and can only be released all at once with arena_free().
+ */
+typedef struct achunk achunk;
+typedef struct {
+	achunk	*chunks;	/* list of chunks, newest first */
+	char	*next;		/* next free byte in newest chunk */
+	char	*end;		/* end of newest chunk */
+	size_t	csize;		/* size of next chunk to allocate */
+} ARENA;
+
+void	*arena_alloc(ARENA *a, size_t len);
+char	*arena_strdup(ARENA *a, char *s);
+void	arena_free(ARENA *a);
+
+#endif
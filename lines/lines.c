@@ -19,13 +19,24 @@
  *       Do not put BitKeeper specific code here
  */
 #define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>		/* before style.h's creat() */
 #include "style.h"
 #include "lines.h"
 
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef	__SSE2__
+#include <immintrin.h>
+#endif
 
 #define	setLLEN(s, len)	(*(u32 *)(s) = (*(u32 *)(s) & ~LMASK) | (len))
 
@@ -213,12 +224,248 @@ _reverseArray(void *space, int size)
 	}
 }
 
+/*
+ * Sorting.  Arrays of strings sorted with string_sort(), the default,
+ * use a multikey quicksort keyed on 8 bytes of each string at a time.
+ * The bytes are cached next to the pointer, so most comparisons
+ * never touch the strings.  Big arrays of them are cut into one run
+ * per thread, the runs are sorted in parallel and then merged in
+ * pairs, also in parallel.  Other comparison functions might not be
+ * safe to call from many threads at once, so those arrays are always
+ * sorted in the caller's thread.
+ */
+#define	SORT_SMALL	16		/* insertion sort below this */
+#define	SORT_PARALLEL	(1 << 16)	/* use threads from this many */
+#define	SORT_THREADS	8
+
+typedef struct {
+	u64	key;		/* 8 bytes of s at the current depth */
+	char	*s;
+} skey;
+
+typedef struct {
+	u8	*base;		/* first element of the run */
+	size_t	n;		/* elements in the run */
+	size_t	n2;		/* merge: elements in the run after it */
+	u8	*out;		/* merge: where the merged runs go */
+	int	size;
+	int	(*compar)(const void *, const void *);
+} sortjob;
+
+/* the bytes of s up to the null, big endian, so they compare like strcmp */
+private inline u64
+skey8(char *s)
+{
+	u64	k = 0;
+	int	i;
+
+	for (i = 0; (i < 8) && s[i]; i++) k |= (u64)(u8)s[i] << (56 - 8*i);
+	return (k);
+}
+
+/* compare two strings that match in the first 'depth' bytes */
+private inline int
+skeycmp(skey *x, skey *y, int depth)
+{
+	if (x->key != y->key) return ((x->key < y->key) ? -1 : 1);
+	unless (x->key & 0xff) return (0);	/* both ended */
+	return (strcmp(x->s + depth + 8, y->s + depth + 8));
+}
+
+#define	SWAP(x, y)	do { skey _t = (x); (x) = (y); (y) = _t; } while (0)
+
+private void
+mkqsort(skey *a, size_t n, int depth)
+{
+	skey	t;
+	size_t	i, j, lt, gt;
+	u64	v, x, y, z;
+
+	while (n > SORT_SMALL) {
+		x = a[0].key;
+		y = a[n/2].key;
+		z = a[n-1].key;
+		if (x < y) {
+			v = (y < z) ? y : ((x < z) ? z : x);
+		} else {
+			v = (x < z) ? x : ((y < z) ? z : y);
+		}
+
+		/* [0, lt) < v, [lt, gt) == v, [gt, n) > v */
+		lt = i = 0;
+		gt = n;
+		while (i < gt) {
+			if (a[i].key < v) {
+				SWAP(a[lt], a[i]);
+				lt++, i++;
+			} else if (a[i].key > v) {
+				gt--;
+				SWAP(a[i], a[gt]);
+			} else {
+				i++;
+			}
+		}
+		/* the middle matches for 8 more bytes, so sort on the next 8 */
+		if ((v & 0xff) && (gt - lt > 1)) {
+			for (i = lt; i < gt; i++) {
+				a[i].key = skey8(a[i].s + depth + 8);
+			}
+			mkqsort(a + lt, gt - lt, depth + 8);
+		}
+		/* recurse on the smaller side and loop on the bigger */
+		if (lt < n - gt) {
+			mkqsort(a, lt, depth);
+			a += gt;
+			n -= gt;
+		} else {
+			mkqsort(a + gt, n - gt, depth);
+			n = lt;
+		}
+	}
+	for (i = 1; i < n; i++) {
+		t = a[i];
+		for (j = i; j && (skeycmp(&t, &a[j-1], depth) < 0); j--) {
+			a[j] = a[j-1];
+		}
+		a[j] = t;
+	}
+}
+
+private void
+strsort(char **base, size_t n)
+{
+	skey	*a;
+	size_t	i;
+
+	if (n < 2) return;
+	a = malloc(n * sizeof(skey));
+	assert(a);
+	for (i = 0; i < n; i++) {
+		a[i].s = base[i];
+		a[i].key = skey8(base[i]);
+	}
+	mkqsort(a, n, 0);
+	for (i = 0; i < n; i++) base[i] = a[i].s;
+	free(a);
+}
+
+private void *
+sortrun(void *arg)
+{
+	sortjob	*j = arg;
+
+	if ((j->compar == string_sort) && (j->size == sizeof(char *))) {
+		strsort((char **)j->base, j->n);
+	} else {
+		qsort(j->base, j->n, j->size, j->compar);
+	}
+	return (0);
+}
+
+/* merge the run at base with the one after it into out */
+private void *
+mergerun(void *arg)
+{
+	sortjob	*j = arg;
+	int	size = j->size;
+	u8	*a = j->base, *ea = a + j->n * size;
+	u8	*b = ea, *eb = b + j->n2 * size;
+	u8	*t = j->out;
+
+	while ((a < ea) && (b < eb)) {
+		if (j->compar(b, a) < 0) {
+			memcpy(t, b, size);
+			b += size;
+		} else {
+			memcpy(t, a, size);
+			a += size;
+		}
+		t += size;
+	}
+	memcpy(t, a, ea - a);
+	memcpy(t + (ea - a), b, eb - b);
+	return (0);
+}
+
+/* run fn on each job, all but the first in their own thread */
+private void
+runjobs(void *(*fn)(void *), sortjob *jobs, int nj)
+{
+	pthread_t	tid[SORT_THREADS];
+	int	i;
+
+	for (i = 1; i < nj; i++) {
+		if (pthread_create(&tid[i], 0, fn, &jobs[i])) {
+			fn(&jobs[i]);
+			tid[i] = 0;
+		}
+	}
+	fn(&jobs[0]);
+	for (i = 1; i < nj; i++) if (tid[i]) pthread_join(tid[i], 0);
+}
+
 void
 _sortArray(void *space, int (*compar)(const void *, const void *), int size)
 {
+	sortjob	jobs[SORT_THREADS];
+	size_t	bound[SORT_THREADS + 1];
+	size_t	n;
+	u8	*base, *tmp, *src, *dst;
+	int	i, m, nj = 1, rev = 0;
+
 	if (!space) return;
 	unless (compar) compar = string_sort;
-	qsort((u8 *)space+size, nLines(space), size, compar);
+	if ((compar == string_sortrev) && (size == sizeof(char *))) {
+		compar = string_sort;
+		rev = 1;
+	}
+	base = (u8 *)space + size;
+	n = nLines(space);
+	if ((n >= SORT_PARALLEL) &&
+	    (compar == string_sort) && (size == sizeof(char *))) {
+		nj = sysconf(_SC_NPROCESSORS_ONLN);
+		nj = max(1, min(nj, SORT_THREADS));
+	}
+	for (i = 0; i <= nj; i++) bound[i] = n * i / nj;
+	memset(jobs, 0, sizeof(jobs));
+	for (i = 0; i < nj; i++) {
+		jobs[i].base = base + bound[i] * size;
+		jobs[i].n = bound[i+1] - bound[i];
+		jobs[i].size = size;
+		jobs[i].compar = compar;
+	}
+	runjobs(sortrun, jobs, nj);
+
+	/* merge pairs of runs until there is only one */
+	if (nj > 1) {
+		tmp = malloc(n * size);
+		assert(tmp);
+		src = base;
+		dst = tmp;
+		while (nj > 1) {
+			for (i = m = 0; i < nj; i += 2, m++) {
+				jobs[m].base = src + bound[i] * size;
+				jobs[m].out = dst + bound[i] * size;
+				jobs[m].n = bound[i+1] - bound[i];
+				jobs[m].n2 =
+				    (i + 1 < nj) ? bound[i+2] - bound[i+1] : 0;
+				bound[m] = bound[i];
+			}
+			bound[m] = n;
+			runjobs(mergerun, jobs, m);
+			nj = m;
+			tmp = src;
+			src = dst;
+			dst = tmp;
+		}
+		if (src != base) {
+			memcpy(base, src, n * size);
+			free(src);
+		} else {
+			free(dst);
+		}
+	}
+	if (rev) _reverseArray(space, size);
 }
 
 /*
@@ -293,6 +540,206 @@ uniqLines(char **space, void(*freep)(void *ptr))
 	truncLines(space, dst);
 }
 
+private	int	removeFrom(char **space, int src, char *s,
+		    void(*freep)(void *ptr));
+
+/*
+ * String sets for uniqLinesHash() and indexLines().  Open addressing
+ * with linear probing, at most half full, and each slot keeps the
+ * string's hash so most mismatches don't touch the string.  Slots
+ * hold the line number of the string, 0 is empty.
+ */
+typedef struct {
+	u32	hash;
+	u32	idx;
+} lslot;
+
+struct lindex {
+	u32	n;		/* lines 1..n are in the index */
+	u32	used;		/* full slots */
+	u32	mask;
+	lslot	*slots;
+};
+
+private u32
+lhash(char *s)
+{
+	size_t	len = strlen(s);
+	u64	w, h = 0x9e3779b97f4a7c15ULL ^ len;
+
+	while (len >= 8) {
+		memcpy(&w, s, 8);
+		h = (h ^ w) * 0xd6e8feb86659fd93ULL;
+		h ^= h >> 32;
+		s += 8;
+		len -= 8;
+	}
+	w = 0;
+	memcpy(&w, s, len);
+	h = (h ^ w) * 0xd6e8feb86659fd93ULL;
+	h ^= h >> 32;
+	return ((u32)h);
+}
+
+private void
+lindex_init(LINDEX *ix, u32 n)
+{
+	u32	size = 16;
+
+	while (size < 2 * n) size <<= 1;
+	ix->n = ix->used = 0;
+	ix->mask = size - 1;
+	ix->slots = calloc(size, sizeof(lslot));
+	assert(ix->slots);
+}
+
+/*
+ * Return the line number of 's' if it is in the set, else 0 and
+ * *slotp is the empty slot where it would go.
+ */
+private u32
+lindex_find(LINDEX *ix, char **space, char *s, u32 hash, lslot **slotp)
+{
+	lslot	*sl;
+	u32	i = hash & ix->mask;
+
+	while ((sl = &ix->slots[i])->idx) {
+		if ((sl->hash == hash) && streq(space[sl->idx], s)) {
+			return (sl->idx);
+		}
+		i = (i + 1) & ix->mask;
+	}
+	if (slotp) *slotp = sl;
+	return (0);
+}
+
+/*
+ * Double the size of the index, the slots keep their hashes so no
+ * strings are looked at.
+ */
+private void
+lindex_grow(LINDEX *ix)
+{
+	lslot	*old = ix->slots;
+	u32	i, j, size = ix->mask + 1;
+
+	ix->mask = 2 * size - 1;
+	ix->slots = calloc(2 * size, sizeof(lslot));
+	assert(ix->slots);
+	for (i = 0; i < size; i++) {
+		unless (old[i].idx) continue;
+		j = old[i].hash & ix->mask;
+		while (ix->slots[j].idx) j = (j + 1) & ix->mask;
+		ix->slots[j] = old[i];
+	}
+	free(old);
+}
+
+/*
+ * Add the lines after ix->n to the index.
+ */
+private void
+lindex_add(LINDEX *ix, char **space)
+{
+	lslot	*sl;
+	u32	h;
+	int	i;
+
+	EACH_START(ix->n + 1, space, i) {
+		if (2 * (ix->used + 1) > ix->mask + 1) lindex_grow(ix);
+		h = lhash(space[i]);
+		if (lindex_find(ix, space, space[i], h, &sl)) continue;
+		sl->hash = h;
+		sl->idx = i;
+		ix->used++;
+	}
+	ix->n = nLines(space);
+}
+
+private void
+lindex_build(LINDEX *ix, char **space)
+{
+	free(ix->slots);
+	lindex_init(ix, nLines(space));
+	lindex_add(ix, space);
+}
+
+/*
+ * Like uniqLines() but doesn't sort: the first copy of each line
+ * stays where it was relative to the others.  O(n) with a hash of
+ * the lines seen so far.
+ */
+void
+uniqLinesHash(char **space, void(*freep)(void *ptr))
+{
+	LINDEX	ix;
+	lslot	*sl;
+	u32	h;
+	int	src, dst = 0;
+
+	unless (nLines(space) > 1) return;
+	lindex_init(&ix, nLines(space));
+	EACH_INDEX(space, src) {
+		h = lhash(space[src]);
+		if (lindex_find(&ix, space, space[src], h, &sl)) {
+			if (freep) freep(space[src]);
+			continue;
+		}
+		space[++dst] = space[src];
+		sl->hash = h;
+		sl->idx = dst;
+	}
+	truncLines(space, dst);
+	free(ix.slots);
+}
+
+LINDEX *
+indexLines(char **space)
+{
+	LINDEX	*ix = new(LINDEX);
+
+	lindex_build(ix, space);
+	return (ix);
+}
+
+/*
+ * Same as findLine(haystack, needle) using the index 'ix' of the
+ * array.  Lines added to the end since the last call are added to
+ * the index; if the array got shorter the index is rebuilt.
+ */
+int
+findLineIndex(char **space, LINDEX *ix, char *needle)
+{
+	if (ix->n > nLines(space)) {
+		lindex_build(ix, space);
+	} else if (ix->n < nLines(space)) {
+		lindex_add(ix, space);
+	}
+	return (lindex_find(ix, space, needle, lhash(needle), 0));
+}
+
+/*
+ * Same as removeLine(space, s, freep), but if 's' isn't there the
+ * index says so without looking at the array.
+ */
+int
+removeLineIndex(char **space, LINDEX *ix, char *s, void(*freep)(void *ptr))
+{
+	int	i;
+
+	unless (i = findLineIndex(space, ix, s)) return (0);
+	ix->n = ~0u;		/* rebuild on next use */
+	return (removeFrom(space, i, s, freep));
+}
+
+void
+freeLinesIndex(LINDEX *ix)
+{
+	unless (ix) return;
+	free(ix->slots);
+	free(ix);
+}
+
 /*
  * Return true if they are the same.
  * It's up to you to sort them first if you want them sorted.
@@ -325,15 +772,24 @@ freeLines(char **space, void(*freep)(void *ptr))
 int
 removeLine(char **space, char *s, void(*freep)(void *ptr))
 {
-	int	src, dst, n = 0;
+	int	src;
 
 	/* skip up to the first match */
 	EACH_INDEX(space, src) {
-		if (streq(space[src], s)) goto match;
+		if (streq(space[src], s)) {
+			return (removeFrom(space, src, s, freep));
+		}
 	}
 	return (0);			/* fast exit */
+}
 
- match:	/* now copy non-matched items */
+/* remove all the lines matching 's' from space[src], the first match */
+private int
+removeFrom(char **space, int src, char *s, void(*freep)(void *ptr))
+{
+	int	dst, n = 0;
+
+	/* now copy non-matched items */
 	dst = src-1;		/* last non-matched item in output */
 	for (; src <= _LLEN(space); src++) { /* EACH() */
 		if (streq(space[src], s)) {
@@ -453,29 +909,172 @@ file2Lines(char **space, char *file)
 		bufsz = 0;
 	}
 	fclose(f);
+	free(buf);
 	return (space);
 }
 
+/* iovecs per writev() */
+#if defined(IOV_MAX) && (IOV_MAX < 1024)
+#define	IOVS		IOV_MAX
+#else
+#define	IOVS		1024
+#endif
+
 /*
- * Fill a file from a lines array.
+ * writev() all of iov[0..n-1], picking up after short writes.
  */
-int
-lines2File(char **space, char *file)
+private int
+writeiov(int fd, struct iovec *iov, int n)
 {
-	FILE	*f;
-	int	i;
-	char	*tmp;
+	ssize_t	w;
+
+	while (n) {
+		if ((w = writev(fd, iov, n)) < 0) {
+			if (errno == EINTR) continue;
+			return (-1);
+		}
+		while (n && (w >= iov->iov_len)) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return (0);
+}
+
+/*
+ * Write each line of 'space' followed by a newline to 'file'.  The
+ * lines are written from where they are with writev().  If 'm' is
+ * set the lines are measured with mapLineLen(), and lines that are
+ * still next to each other in the map, newlines and all, go out as
+ * one iovec.
+ */
+private int
+writeLines(char **space, MLINES *m, char *file)
+{
+	struct	iovec	iov[IOVS];
+	int	fd, i, ok, len, n = 0;
+	char	*s, *tmp;
 	int	rc = -1;
 
 	unless (file) return (-1);
 	i = asprintf(&tmp, "%s.tmp.%u", file, (int)getpid());
-	unless (f = fopen(tmp, "w")) goto out;
-	EACH(space) fprintf(f, "%s\n", space[i]);
-	if (fclose(f) || (rc = rename(tmp, file))) unlink(tmp);
+	if ((fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0) goto out;
+	EACH(space) {
+		s = space[i];
+		len = m ? mapLineLen(m, i) : strlen(s);
+		if (s[len] != '\n') {
+			iov[n].iov_base = s;
+			iov[n++].iov_len = len;
+			iov[n].iov_base = "\n";
+			iov[n++].iov_len = 1;
+		} else if (n &&
+		    ((char *)iov[n-1].iov_base + iov[n-1].iov_len == s)) {
+			/* a run of lines still in place in a map */
+			iov[n-1].iov_len += len + 1;
+			continue;
+		} else {
+			iov[n].iov_base = s;
+			iov[n++].iov_len = len + 1;
+		}
+		if (n >= IOVS - 1) {
+			if (writeiov(fd, iov, n)) break;
+			n = 0;
+		}
+	}
+	/* i is only past the end if every writeiov() worked */
+	ok = (i > nLines(space)) && !writeiov(fd, iov, n);
+	if (close(fd) || !ok || rename(tmp, file)) {
+		unlink(tmp);
+		goto out;
+	}
+	rc = 0;
 out:	free(tmp);
 	return (rc);
 }
 
+/*
+ * Fill a file from a lines array.
+ */
+int
+lines2File(char **space, char *file)
+{
+	return (writeLines(space, 0, file));
+}
+
+/*
+ * Pre allocate space for 'n' lines in a->lines.
+ */
+void
+allocLinesArena(ALINES *a, int n)
+{
+	assert(!a->lines);
+	a->lines = allocLines(n);
+}
+
+/*
+ * Add a copy of 'line' to a->lines.  The copy is made in a's arena,
+ * so it is freed with the rest by freeLinesArena() and must not be
+ * passed to free().  Returns the copy.
+ */
+char	*
+addLineCopy(ALINES *a, char *line)
+{
+	return (addLineCopyN(a, line, strlen(line)));
+}
+
+/*
+ * Same as addLineCopy() for the first 'len' bytes of 'line', which
+ * need not be null terminated.  The copy is.
+ */
+char	*
+addLineCopyN(ALINES *a, char *line, int len)
+{
+	char	*copy = arena_alloc(&a->arena, len + 1);
+
+	memcpy(copy, line, len);
+	copy[len] = 0;
+	a->lines = addLine(a->lines, copy);
+	return (copy);
+}
+
+/*
+ * Like file2Lines() but the lines are copied into a's arena.  One
+ * buffer is reused for reading so the only allocations are the
+ * arena's chunks and the growth of a->lines.
+ */
+void
+file2LinesArena(ALINES *a, char *file)
+{
+	FILE	*f;
+	char	*buf = 0;
+	size_t	bufsz = 0;
+	int	len;
+
+	unless (file && (f = fopen(file, "r"))) return;
+	while ((len = getline(&buf, &bufsz, f)) > 0) {
+		while ((len > 1) &&
+		    ((buf[len-1] == '\n') || (buf[len-1] == '\r'))) {
+			buf[--len] = 0;
+		}
+		addLineCopyN(a, buf, len);
+	}
+	fclose(f);
+	free(buf);
+}
+
+void
+freeLinesArena(ALINES *a)
+{
+	freeLines(a->lines, 0);
+	a->lines = 0;
+	arena_free(&a->arena);
+}
+
 /*
  * Like perl's join(),
  * use it for making arbitrary length strings.
@@ -513,6 +1112,153 @@ joinLines(char *sep, char **space)
 	return (buf);
 }
 
+/*
+ * The tokenizer behind splitLine().  With SSE2 the string is read
+ * 64 aligned bytes at a time (two 32-byte loads with AVX2, four
+ * 16-byte loads otherwise), compared against each delimiter to get
+ * a bitmask of the delimiters, and the tokens are found from the
+ * bits where the mask changes.  Aligned loads never cross into the
+ * next page, so reading past the end of the string is safe, but
+ * ASAN doesn't know that.
+ */
+#define	SETMAX		16	/* most delimiters for the SIMD code */
+
+#if defined(__SANITIZE_ADDRESS__)
+#define	NOASAN	__attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define	NOASAN	__attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef	NOASAN
+#define	NOASAN
+#endif
+
+#ifdef	__SSE2__
+/*
+ * Return a mask of the bytes of the aligned 64 bytes at p that are
+ * in delim[0..n-1], bit i for p[i], and put a mask of the nulls in
+ * *zero.
+ */
+NOASAN private u64
+blockmask(u8 *p, u8 *delim, int n, u64 *zero)
+{
+	int	i, j;
+#ifdef	__AVX2__
+	__m256i	b[2], m[2], c, z = _mm256_setzero_si256();
+	u32	lo, hi;
+
+	for (j = 0; j < 2; j++) {
+		b[j] = _mm256_load_si256((__m256i *)(p + 32*j));
+		m[j] = z;
+	}
+	lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b[0], z));
+	hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b[1], z));
+	*zero = lo | ((u64)hi << 32);
+	for (i = 0; i < n; i++) {
+		c = _mm256_set1_epi8(delim[i]);
+		for (j = 0; j < 2; j++) {
+			m[j] = _mm256_or_si256(m[j],
+			    _mm256_cmpeq_epi8(b[j], c));
+		}
+	}
+	lo = _mm256_movemask_epi8(m[0]);
+	hi = _mm256_movemask_epi8(m[1]);
+	return (lo | ((u64)hi << 32));
+#else
+	__m128i	b[4], m[4], c, z = _mm_setzero_si128();
+	u64	ret = 0, zm = 0;
+
+	for (j = 0; j < 4; j++) {
+		b[j] = _mm_load_si128((__m128i *)(p + 16*j));
+		m[j] = z;
+		zm |= (u64)(u16)_mm_movemask_epi8(_mm_cmpeq_epi8(b[j], z))
+		    << (16*j);
+	}
+	for (i = 0; i < n; i++) {
+		c = _mm_set1_epi8(delim[i]);
+		for (j = 0; j < 4; j++) {
+			m[j] = _mm_or_si128(m[j], _mm_cmpeq_epi8(b[j], c));
+		}
+	}
+	for (j = 0; j < 4; j++) {
+		ret |= (u64)(u16)_mm_movemask_epi8(m[j]) << (16*j);
+	}
+	*zero = zm;
+	return (ret);
+#endif
+}
+#endif
+
+/*
+ * Split 'line' on any of the bytes in 'delim' and add each token to
+ * either *tokens, as a malloc'ed copy, or *views.
+ */
+private void
+tokenize(char *line, char *delim, char ***tokens, LVIEW **views)
+{
+	char	*p, *start = 0;
+	LVIEW	*v;
+	int	len, n = strlen(delim);
+#ifdef	__SSE2__
+	u8	*b;
+	u64	d, z, t, x, pre, prev = 0;
+	int	done = 0;
+
+	if (n <= SETMAX) {
+		b = (u8 *)((uintptr_t)line & ~(uintptr_t)63);
+		/* bytes before the line act as delimiters */
+		pre = ((u64)1 << ((u8 *)line - b)) - 1;
+		for (; !done; b += 64) {
+			d = blockmask(b, (u8 *)delim, n, &z) | pre;
+			if ((z &= ~pre)) {
+				/* and so does everything from the null on */
+				d |= ~(u64)0 << __builtin_ctzll(z);
+				done = 1;
+			}
+			pre = 0;
+
+			/* bits where we go in or out of a token */
+			t = ~d;
+			x = t ^ ((t << 1) | prev);
+			prev = t >> 63;
+			while (x) {
+				p = (char *)b + __builtin_ctzll(x);
+				x &= x - 1;
+				unless (start) {
+					start = p;
+					continue;
+				}
+				len = p - start;
+				if (tokens) {
+					*tokens = addLine(*tokens,
+					    strndup(start, len));
+				} else {
+					v = addArray(views, 0);
+					v->off = start - line;
+					v->len = len;
+				}
+				start = 0;
+			}
+		}
+		return;
+	}
+#endif
+	p = line;
+	while (1) {
+		p += strspn(p, delim); /* skip delimiters */
+		unless (len = strcspn(p, delim)) break;
+		if (tokens) {
+			*tokens = addLine(*tokens, strndup(p, len));
+		} else {
+			v = addArray(views, 0);
+			v->off = p - line;
+			v->len = len;
+		}
+		p += len;
+	}
+}
+
 /*
  * Split a C string into tokens like strtok()
  *
@@ -525,16 +1271,211 @@ joinLines(char *sep, char **space)
 char   **
 splitLine(char *line, char *delim, char **tokens)
 {
-	int     len;
+	tokenize(line, delim, &tokens, 0);
+	return (tokens);
+}
+
+/*
+ * Like splitLine() but nothing is copied: each token is added to
+ * 'views' as its offset and length in 'line'.
+ *
+ *	LVIEW	*v = splitLineViews(line, ",", 0);
+ *	EACH(v) printf("%.*s\n", v[i].len, line + v[i].off);
+ *	free(v);
+ */
+LVIEW *
+splitLineViews(char *line, char *delim, LVIEW *views)
+{
+	tokenize(line, delim, 0, &views);
+	return (views);
+}
 
+/*
+ * Add the line from 'start' up to 'end' to m->lines.
+ */
+private inline void
+mapline(MLINES *m, char *start, char *end)
+{
+	m->lines = addLine(m->lines, start);
+	if (m->flags & MLINES_NUL) {
+		do *end = 0; while ((end > start) && (*--end == '\r'));
+	}
+}
+
+/*
+ * Map the regular file 'fd' of 'size' bytes for file2LinesMap().
+ * Returns -1 with nothing mapped if that fails.
+ */
+private int
+mapfile(MLINES *m, int fd, size_t size)
+{
+	size_t	pg = sysconf(_SC_PAGESIZE);
+	int	prot = PROT_READ;
+
+	if (m->flags & MLINES_NUL) prot |= PROT_WRITE;
+
+	/* zero pages to cover the file and a null after it */
+	m->size = size;
+	m->maplen = (m->size + pg) & ~(pg - 1);
+	m->map = mmap(0, m->maplen, prot, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m->map == MAP_FAILED) {
+		m->map = 0;
+		return (-1);
+	}
+	/* and the file over the start of them */
+	if (m->size && (mmap(m->map, m->size, prot, MAP_FIXED |
+	    ((m->flags & MLINES_NUL) ? MAP_PRIVATE : MAP_SHARED),
+	    fd, 0) == MAP_FAILED)) {
+		munmap(m->map, m->maplen);
+		m->map = 0;
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Pipes and the like can't be mapped, so read 'fd' into anonymous
+ * memory instead, doubling it as needed.
+ */
+private int
+readfile(MLINES *m, int fd)
+{
+	size_t	pg = sysconf(_SC_PAGESIZE);
+	ssize_t	r;
+	char	*p;
+	size_t	len;
+
+	m->size = m->maplen = 0;
 	while (1) {
-		line += strspn(line, delim); /* skip delimiters */
-		len = strcspn(line, delim);
-		unless (len) break;
-		tokens = addLine(tokens, strndup(line, len));
-		line += len;
+		if (m->size + 1 >= m->maplen) {
+			len = max(2 * m->maplen, 16 * pg);
+			p = mmap(0, len, PROT_READ|PROT_WRITE,
+			    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED) return (-1);
+			if (m->map) {
+				memcpy(p, m->map, m->size);
+				munmap(m->map, m->maplen);
+			}
+			m->map = p;
+			m->maplen = len;
+		}
+		r = read(fd, m->map + m->size, m->maplen - m->size - 1);
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			return (-1);
+		}
+		unless (r) break;
+		m->size += r;
 	}
-	return (tokens);
+	unless (m->flags & MLINES_NUL) mprotect(m->map, m->maplen, PROT_READ);
+	return (0);
+}
+
+/*
+ * Map 'file' and add a pointer to each of its lines to m->lines.
+ * Nothing is copied, the only allocation is m->lines itself.
+ *
+ * By default the mapping is shared and read-only and each line runs
+ * up to its newline; use mapLineLen() for the length.  With
+ * MLINES_NUL the mapping is private and the newlines (and any \r's
+ * before them) are overwritten with nulls, so the lines are C strings
+ * and work with the rest of the lines functions.  The kernel copies
+ * each page when it is first written; the file itself is unchanged.
+ *
+ * The mapping has at least one null after the file so the last line
+ * is terminated either way.  Files that can't be mapped, like pipes,
+ * or that say they are empty, like the ones in /proc, are read into
+ * memory that is then used the same way.  Returns -1 with errno set
+ * if the file can't be read, or 0.
+ */
+int
+file2LinesMap(MLINES *m, char *file, int flags)
+{
+	struct	stat st;
+	char	*start, *end, *nl;
+	int	fd, rc;
+#ifdef	__SSE2__
+	u8	*b;
+	u64	d, z;
+#endif
+
+	assert(!m->lines && !m->map);
+	if ((fd = open(file, O_RDONLY, 0)) < 0) return (-1);
+	if (fstat(fd, &st)) {
+		close(fd);
+		return (-1);
+	}
+	m->flags = flags;
+	rc = -1;
+	if (S_ISREG(st.st_mode) && st.st_size) rc = mapfile(m, fd, st.st_size);
+	if (rc) rc = readfile(m, fd);
+	close(fd);
+	if (rc) {
+		rc = errno;
+		freeLinesMap(m);
+		errno = rc;
+		return (-1);
+	}
+	unless (m->size) return (0);
+	madvise(m->map, m->size, MADV_SEQUENTIAL);
+
+	start = m->map;
+	end = m->map + m->size;
+#ifdef	__SSE2__
+	/* the map is page aligned so the last block is in it too */
+	for (b = (u8 *)m->map; b < (u8 *)end; b += 64) {
+		d = blockmask(b, (u8 *)"\n", 1, &z);
+		if (b + 64 > (u8 *)end) d &= ((u64)1 << ((u8 *)end - b)) - 1;
+		while (d) {
+			nl = (char *)b + __builtin_ctzll(d);
+			d &= d - 1;
+			mapline(m, start, nl);
+			start = nl + 1;
+		}
+	}
+#else
+	while ((nl = memchr(start, '\n', end - start))) {
+		mapline(m, start, nl);
+		start = nl + 1;
+	}
+#endif
+	if (start < end) mapline(m, start, end);
+	return (0);
+}
+
+/*
+ * The length of m->lines[i] without the newline and any \r's before
+ * it.  The lines can be reordered but must still point into the map.
+ */
+int
+mapLineLen(MLINES *m, int i)
+{
+	char	*s = m->lines[i], *e;
+
+	if (m->flags & MLINES_NUL) return (strlen(s));
+	unless (e = memchr(s, '\n', m->map + m->size - s)) {
+		e = m->map + m->size;
+	}
+	while ((e > s) && (e[-1] == '\r')) e--;
+	return (e - s);
+}
+
+/*
+ * lines2File() for m->lines, which need not be null terminated.
+ */
+int
+mapLines2File(MLINES *m, char *file)
+{
+	return (writeLines(m->lines, m, file));
+}
+
+void
+freeLinesMap(MLINES *m)
+{
+	freeLines(m->lines, 0);
+	m->lines = 0;
+	if (m->map) munmap(m->map, m->maplen);
+	m->map = 0;
 }
 
 /*
@@ -571,6 +1512,14 @@ shellquote(char *in)
         return (out);
 }
 
+/* the bytes that end a run of plain characters in shellSplit() */
+private	const	u8	shspecial[256] = {
+	[0] = 1, [' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\r'] = 1,
+	['\''] = 1, ['"'] = 1, ['\\'] = 1, ['>'] = 1, ['<'] = 1, ['|'] = 1,
+	['`'] = 1, ['$'] = 1, ['&'] = 1, [';'] = 1, ['['] = 1, [']'] = 1,
+	['*'] = 1, ['('] = 1, [')'] = 1,
+};
+
 /*
  * Takes a string, parses it like /bin/sh, and splits it into
  * tokens.  The result is is returned in a lines array.
@@ -721,6 +1670,19 @@ shellSplit(const char *line)
 			} else {
 				*pout++ = *pin++;
 				item = 1;
+
+				/* and the plain characters after it */
+				for (ein = pin; !shspecial[(u8)*ein]; ein++);
+				/* leave a digit before < or > for above */
+				if ((ein > pin) &&
+				    ((*ein == '<') || (*ein == '>')) &&
+				    isdigit((u8)ein[-1])) {
+					--ein;
+				}
+				BUF_RESIZE(ein - pin + 2);
+				memcpy(pout, pin, ein - pin);
+				pout += ein - pin;
+				pin = ein;
 			}
 			break;
 		}
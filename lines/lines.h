@@ -38,11 +38,36 @@
  *	remove the 'i'th line.
  * lines = splitLine(buf, delim, lines)
  *	split buf on any/all chars in delim and put the tokens in lines.
+ * views = splitLineViews(buf, delim, views)
+ *	same, but add the offset and length of each token to views.
  * buf = joinLines(":", s)
  *	return one string which is all the strings glued together with ":"
  *	does not free s, caller must free s.
  * buf = findLine(lines, needle);
  *	Return the index the line in lines that matches needle
+ * uniqLinesHash(s, freep)
+ *	remove duplicate lines, keeping the first of each in place.
+ * ix = indexLines(s)
+ *	build an index for findLineIndex() and removeLineIndex(),
+ *	free it with freeLinesIndex(ix).
+ *
+ * Lines that own their strings (ALINES):
+ *
+ * allocLinesArena(&a, n)
+ *	pre allocate space for n lines in a.lines.
+ * copy = addLineCopy(&a, line)
+ *	copy line into a's arena and add the copy to a.lines.
+ * freeLinesArena(&a)
+ *	free a.lines and all the strings in it, one free() per chunk.
+ *
+ * Lines in a mmap'ed file (MLINES):
+ *
+ * file2LinesMap(&m, file, flags)
+ *	point m.lines at each line of file, nothing is copied.
+ * len = mapLineLen(&m, i)
+ *	the length of m.lines[i] without its newline.
+ * freeLinesMap(&m)
+ *	free m.lines and unmap the file.
  */
 #ifndef	_LIB_LINES_H
 #define	_LIB_LINES_H
@@ -52,6 +77,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+
 #define	INVALID		(void *)~0u /* invalid pointer */
 
 /* lines are limited to 2^27 entries ~134 million */
@@ -114,6 +141,14 @@ void	*removeLineN(char **space, int rm, void(*freep)(void *ptr));
 #define	unshiftLine(s, val)	insertLineN(s, 1, val)
 
 char	**splitLine(char *line, char *delim, char **tokens);
+
+/* a token found by splitLineViews() */
+typedef struct {
+	u32	off;		/* offset in the line */
+	u32	len;		/* length of the token */
+} LVIEW;
+
+LVIEW	*splitLineViews(char *line, char *delim, LVIEW *views);
 char	*joinLines(char *sep, char **space);
 void	freeLines(char **space, void(*freep)(void *ptr));
 int	removeLine(char **space, char *s, void(*freep)(void *ptr));
@@ -132,6 +167,57 @@ int	sameLines(char **p, char **p2);
 char	*shellquote(char *in);
 int	findLine(char **haystack, char *needle);
 
+/*
+ * A hash index of the strings in a lines array, so finding one
+ * doesn't need a linear scan.  Lines appended with addLine() are
+ * picked up as needed, but the index must be rebuilt with
+ * indexLines() after lines are removed other than with
+ * removeLineIndex(), reordered or replaced in place.
+ */
+typedef	struct lindex	LINDEX;
+
+void	uniqLinesHash(char **space, void(*freep)(void *ptr));
+LINDEX	*indexLines(char **space);
+int	findLineIndex(char **space, LINDEX *ix, char *needle);
+int	removeLineIndex(char **space, LINDEX *ix, char *s,
+	    void(*freep)(void *ptr));
+void	freeLinesIndex(LINDEX *ix);
+
+/*
+ * A lines array and an arena holding its strings.  'lines' is an
+ * ordinary lines array and can be walked, sorted and searched with
+ * the usual functions, but only freed with freeLinesArena().
+ * Start with ALINES a = {0}.
+ */
+typedef struct {
+	char	**lines;
+	ARENA	arena;
+} ALINES;
+
+void	allocLinesArena(ALINES *a, int n);
+char	*addLineCopy(ALINES *a, char *line);
+char	*addLineCopyN(ALINES *a, char *line, int len);
+void	file2LinesArena(ALINES *a, char *file);
+void	freeLinesArena(ALINES *a);
+
+/*
+ * A lines array pointing into a mmap'ed file, see file2LinesMap().
+ * Start with MLINES m = {0}.
+ */
+typedef struct {
+	char	**lines;
+	char	*map;
+	size_t	size;		/* of the file */
+	size_t	maplen;		/* of the mapping */
+	int	flags;
+} MLINES;
+#define	MLINES_NUL	0x01	/* null terminate each line */
+
+int	file2LinesMap(MLINES *m, char *file, int flags);
+int	mapLineLen(MLINES *m, int i);
+int	mapLines2File(MLINES *m, char *file);
+void	freeLinesMap(MLINES *m);
+
 int	parallelLines(char **a, char **b,
     int (*compar)(const void *, const void *),
     int (*walk)(void *token, char *a, char *b),
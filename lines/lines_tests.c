@@ -74,6 +74,67 @@ uniqLines_test(void)
 	}
 }
 
+private void
+uniqLinesHash_test(void)
+{
+	int	i;
+	char	*t;
+	char	**lines;
+	LINDEX	*ix;
+	struct {
+		char	*in;
+		char	*out;
+	} tests[] = {
+		{ "1", "1" },
+		{ "2,1", "2,1" },
+		{ "1,1", "1" },
+		{ "2,2,1", "2,1" },
+		{ "1,2,1", "1,2" },
+		{ "4,4,3,1,3,2,2", "4,3,1,2" },
+		{ 0, 0 }};
+
+	for (i = 0; tests[i].in; i++) {
+		lines = splitLine(tests[i].in, ",", 0);
+		uniqLinesHash(lines, free);
+		t = joinLines(",", lines);
+		freeLines(lines, free);
+		unless (streq(t, tests[i].out)) {
+			fprintf(stderr, "uniqLinesHash test failure:\n"
+			    "\t%s->%s (want %s)\n",
+			    tests[i].in, t, tests[i].out);
+			exit(1);
+		}
+		free(t);
+	}
+
+	lines = splitLine("a,b,c,b", ",", 0);
+	ix = indexLines(lines);
+	assert(findLineIndex(lines, ix, "b") == 2);
+	assert(findLineIndex(lines, ix, "d") == 0);
+	assert(removeLineIndex(lines, ix, "b", free) == 2);
+	assert(findLineIndex(lines, ix, "c") == 2);
+	lines = addLine(lines, strdup("d"));
+	assert(findLineIndex(lines, ix, "d") == 3);
+	freeLinesIndex(ix);
+	freeLines(lines, free);
+
+	/* add what isn't there yet, the index grows with the array */
+	lines = 0;
+	ix = indexLines(lines);
+	for (i = 0; i < 20000; i++) {
+		char	buf[16];
+
+		sprintf(buf, "%d", (i * 7) % 5000);
+		unless (findLineIndex(lines, ix, buf)) {
+			lines = addLine(lines, strdup(buf));
+		}
+	}
+	assert(nLines(lines) == 5000);
+	EACH(lines) assert(findLineIndex(lines, ix, lines[i]) == i);
+	freeLinesIndex(ix);
+	freeLines(lines, free);
+}
+
 private void
 databuf_tests(void)
 {
@@ -89,10 +150,152 @@ databuf_tests(void)
 	out = fmem_close(data, 0);
 	free(out);
 }
+
+/*
+ * Check sortLines() against qsort() with strings that share long
+ * prefixes, are prefixes of each other or have bytes >= 0x80, and
+ * enough of them to take the threaded path.
+ */
+private void
+sortLines_test(void)
+{
+	char	**a = 0, **b;
+	char	buf[64];
+	int	i, n = (1 << 16) + 1000;
+
+	for (i = 0; i < n; i++) {
+		switch (i % 4) {
+		    case 0:
+			sprintf(buf, "src/lib/common/prefix/file%d.c", i % 5000);
+			break;
+		    case 1:
+			sprintf(buf, "%.*s", i % 12, "abcdefghijkl");
+			break;
+		    case 2:
+			sprintf(buf, "x\xe9\xff%c%d", 0x80 + i % 100, i);
+			break;
+		    default:
+			sprintf(buf, "%u", (i * 2654435761u) >> 12);
+			break;
+		}
+		a = addLine(a, strdup(buf));
+	}
+	b = allocLines(n);
+	EACH(a) b = addLine(b, a[i]);
+
+	sortLines(a, 0);
+	qsort(b + 1, n, sizeof(char *), string_sort);
+	EACH(a) assert(streq(a[i], b[i]));
+
+	sortLines(a, string_sortrev);
+	qsort(b + 1, n, sizeof(char *), string_sortrev);
+	EACH(a) assert(streq(a[i], b[i]));
+
+	freeLines(b, 0);
+	freeLines(a, free);
+}
+
+private void
+arenaLines_test(void)
+{
+	ALINES	a = {0};
+	char	*t;
+	int	i;
+
+	allocLinesArena(&a, 4);
+	assert(nLines(a.lines) == 0);
+	t = addLineCopyN(&a, "abcdef", 3);
+	assert(streq(t, "abc") && (a.lines[1] == t));
+	for (i = 0; i < 10000; i++) addLineCopy(&a, "0123456789");
+	addLineCopy(&a, "");
+	assert(nLines(a.lines) == 10002);
+	sortLines(a.lines, 0);
+	assert(streq(a.lines[1], ""));
+	assert(streq(a.lines[10002], "abc"));
+	freeLinesArena(&a);
+	assert(a.lines == 0);
+}
+
+private void
+splitLine_test(void)
+{
+	char	*line = "  one,two ,, three\n";
+	char	**t;
+	LVIEW	*v;
+
+	t = splitLine(line, " ,\n", 0);
+	assert(nLines(t) == 3);
+	assert(streq(t[1], "one") && streq(t[2], "two") &&
+	    streq(t[3], "three"));
+	v = splitLineViews(line, " ,\n", 0);
+	assert(nLines(v) == 3);
+	assert((v[1].off == 2) && (v[1].len == 3));
+	assert((v[3].off == 13) && (v[3].len == 5));
+	freeLines(t, free);
+	free(v);
+	t = shellSplit("cmd -x 'a b' c\\ d 2>err");
+	assert(nLines(t) == 6);
+	assert(streq(t[3], "a b") && streq(t[4], "c d"));
+	assert(streq(t[5], "2>") && (t[5][3] == 1));	/* a redirect */
+	assert(streq(t[6], "err") && (t[6][4] == 0));
+	freeLines(t, free);
+}
+
+private void
+mapLines_test(void)
+{
+	MLINES	m = {0};
+	char	**t = 0;
+	FILE	*f;
+
+	f = fopen("lines_test.tmp", "w");
+	fputs("one\ntwo\r\n\nthree", f);
+	fclose(f);
+	assert(!file2LinesMap(&m, "lines_test.tmp", 0));
+	assert(nLines(m.lines) == 4);
+	assert((mapLineLen(&m, 1) == 3) && !strncmp(m.lines[1], "one", 3));
+	assert(mapLineLen(&m, 2) == 3);
+	assert(mapLineLen(&m, 3) == 0);
+	assert(mapLineLen(&m, 4) == 5);
+	assert(!mapLines2File(&m, "lines_test.tmp"));
+	freeLinesMap(&m);
+	assert(!file2LinesMap(&m, "lines_test.tmp", MLINES_NUL));
+	assert(nLines(m.lines) == 4);
+	assert(streq(m.lines[2], "two") && streq(m.lines[4], "three"));
+	t = addLine(t, "x");
+	t = addLine(t, "");
+	assert(!lines2File(t, "lines_test.tmp"));
+	freeLinesMap(&m);
+	assert(!file2LinesMap(&m, "lines_test.tmp", MLINES_NUL));
+	assert(sameLines(m.lines, t));
+	freeLinesMap(&m);
+	freeLines(t, 0);
+
+	/* an empty file, and one that only says it is */
+	fclose(fopen("lines_test.tmp", "w"));
+	assert(!file2LinesMap(&m, "lines_test.tmp", 0));
+	assert(nLines(m.lines) == 0);
+	freeLinesMap(&m);
+	unlink("lines_test.tmp");
+	unless (access("/proc/self/status", R_OK)) {
+		t = file2Lines(0, "/proc/self/status");
+		assert(!file2LinesMap(&m, "/proc/self/status", MLINES_NUL));
+		assert(nLines(t) && (nLines(m.lines) == nLines(t)));
+		assert(streq(m.lines[1], t[1]));
+		freeLinesMap(&m);
+		freeLines(t, free);
+	}
+}
+
 void
 lines_tests(void)
 {
 	uniqLines_test();
+	uniqLinesHash_test();
+	sortLines_test();
 	databuf_tests();
+	arenaLines_test();
+	splitLine_test();
+	mapLines_test();
 
 }
@@ -75,6 +75,42 @@ webencode(FILE *out, u8 *ptr, int len)
 	if (len == 0) fputs("%FF", out);
 }
 
+/*
+ * Same as webencode() but appends to 'd' with no stdio in the way.
+ * The worst case of 3 bytes per byte is reserved up front so the
+ * loop never checks for space.
+ */
+void
+webencodeData(DATA *d, u8 *ptr, int len)
+{
+	char	*hex = "0123456789abcdef";
+	char	*t;
+
+	data_resize(d, d->len + 3 * len + 4);
+	t = d->buf + d->len;
+	while (len > 0) {
+		if ((len == 1) && !*ptr) break;
+
+		if (*ptr == ' ') {
+			*t++ = '+';
+		} else if (is_encoded(*ptr)) {
+			*t++ = '%';
+			*t++ = hex[*ptr >> 4];
+			*t++ = hex[*ptr & 0xf];
+		} else {
+			*t++ = *ptr;
+		}
+		++ptr;
+		--len;
+	}
+	if (len == 0) {
+		memcpy(t, "%FF", 3);
+		t += 3;
+	}
+	*t = 0;
+	d->len = t - d->buf;
+}
+
 /*
  * unpack a wrapped string from *data and put it in the buffer buf.
  * The string ends on the first '&' '=' or '\0'.
@@ -84,14 +120,41 @@ webencode(FILE *out, u8 *ptr, int len)
 char *
 webdecode(char *data, char **buf, int *sizep)
 {
-	char	*p = data;
-	char	*t;
 	char	*ret;
-	int	c;
-	int	bin = 0;
 
 	assert(buf);
-	ret = t = malloc(strcspn(data, "=&") + 1);
+	ret = malloc(strcspn(data, "=&") + 1);
+	unless (data = webdecodeBuf(data, ret, sizep)) {
+		free(ret);
+		return (0);
+	}
+	*buf = ret;
+	return (data);
+}
+
+private inline int
+unhex(int c)
+{
+	if ((c >= '0') && (c <= '9')) return (c - '0');
+	if ((c >= 'a') && (c <= 'f')) return (c - 'a' + 10);
+	if ((c >= 'A') && (c <= 'F')) return (c - 'A' + 10);
+	return (-1);
+}
+
+/*
+ * Like webdecode() but the data is unpacked into 'buf', which the
+ * caller provides and which needs room for strcspn(data, "=&") + 1
+ * bytes.  Nothing is allocated, so the same buffer can be used to
+ * decode a whole query string one field at a time.
+ */
+char *
+webdecodeBuf(char *data, char *buf, int *sizep)
+{
+	char	*p = data;
+	char	*t = buf;
+	int	hi, lo;
+	int	bin = 0;
+
 	while (1) {
 		switch (*p) {
 		    case '+':
@@ -103,14 +166,16 @@ webdecode(char *data, char **buf, int *sizep)
 				p += 2;
 				break;
 			}
-			unless (sscanf(p+1, "%2x", &c) == 1) goto err;
-			*t++ = c;
+			if (((hi = unhex(p[1])) < 0) ||
+			    ((lo = unhex(p[2])) < 0)) {
+				goto err;
+			}
+			*t++ = (hi << 4) | lo;
 			p += 2;
 			break;
 		    case '&': case '=': case 0:
 			unless (bin) *t++ = 0; /* add trailing null */
-			if (sizep) *sizep = (t - ret);
-			*buf = ret;
+			if (sizep) *sizep = (t - buf);
 			return (p);
 		    default:
 			*t++ = *p;
@@ -3,8 +3,11 @@
 
 #include <stdio.h>
 #include "style.h"
+#include "lines/data.h"
 
 void	webencode(FILE *out, u8 *ptr, int len);
+void	webencodeData(DATA *d, u8 *ptr, int len);
 char	*webdecode(char *data, char **buf, int *sizep);
+char	*webdecodeBuf(char *data, char *buf, int *sizep);
 
 #endif